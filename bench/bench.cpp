@@ -0,0 +1,783 @@
+/*
+	Copyright (c) 2020, Electrux
+	All rights reserved.
+	Using the BSD 3-Clause license for the project,
+	main LICENSE file resides in project's root directory.
+	Please read that file and understand the license terms
+	before using or altering the project.
+*/
+
+// benchmark driver for the std modules - loaded by bench/run.fer, which provides the VM
+// the microbenchmarks call the native functions directly (bypassing the interpreter)
+// on generated inputs which are identical for every run of the same scale
+
+#include <ctime>
+#include <cstdio>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <feral/VM/VM.hpp>
+
+// natives of the std modules which are benchmarked
+var_base_t * str_split( vm_state_t & vm, const fn_data_t & fd );
+var_base_t * vec_push( vm_state_t & vm, const fn_data_t & fd );
+var_base_t * vec_at( vm_state_t & vm, const fn_data_t & fd );
+var_base_t * map_insert( vm_state_t & vm, const fn_data_t & fd );
+var_base_t * map_get( vm_state_t & vm, const fn_data_t & fd );
+var_base_t * fs_read_all( vm_state_t & vm, const fn_data_t & fd );
+var_base_t * fs_file_lines( vm_state_t & vm, const fn_data_t & fd );
+var_base_t * fs_mmap( vm_state_t & vm, const fn_data_t & fd );
+var_base_t * fs_mmap_line_count( vm_state_t & vm, const fn_data_t & fd );
+var_base_t * fs_walk( vm_state_t & vm, const fn_data_t & fd );
+var_base_t * fs_walker_next( vm_state_t & vm, const fn_data_t & fd );
+var_base_t * fs_stat_many( vm_state_t & vm, const fn_data_t & fd );
+var_base_t * hash_str( vm_state_t & vm, const fn_data_t & fd );
+var_base_t * os_copy( vm_state_t & vm, const fn_data_t & fd );
+var_base_t * os_rm( vm_state_t & vm, const fn_data_t & fd );
+
+// input sizes at scale 1, everything grows linearly with the scale
+const size_t BENCH_STR_BYTES = 8 << 20;
+const size_t BENCH_ELEMS = 1 << 20;
+const size_t BENCH_FILE_BYTES = 64 << 20;
+const size_t BENCH_FILE_CHUNK_BYTES = 1 << 20;
+const size_t BENCH_HASH_BYTES = 16 << 20;
+const size_t BENCH_TREE_DEPTH = 6;
+const size_t BENCH_TREE_FANOUT = 3;
+const size_t BENCH_TREE_FILES = 8; // per directory
+
+// regressions are flagged when the median grows by more than the threshold percentage,
+// and by at least this many nanoseconds (to ignore noise on tiny timings)
+const int64_t BENCH_MIN_DELTA_NS = 1000;
+
+struct bench_result_t
+{
+	std::string name;
+	std::string kind; // micro or macro
+	size_t iters;
+	int64_t min_ns;
+	int64_t median_ns;
+	int64_t mean_ns;
+	int64_t max_ns;
+};
+
+// results of this run, in the order they were recorded
+static std::vector< bench_result_t > results;
+
+// deterministic input generator
+struct lcg_t
+{
+	uint64_t state;
+	lcg_t( const uint64_t & seed );
+	uint32_t next();
+};
+
+// lazily generated inputs, shared by all the benchmarks of a run
+struct bench_ctx_t
+{
+	vm_state_t & vm;
+	size_t src_id;
+	size_t idx;
+	size_t scale;
+	std::string dir;
+
+	var_base_t * words;
+	var_base_t * blob;
+	var_base_t * ints;
+	var_base_t * keys;
+	var_base_t * map;
+	var_base_t * tree_files;
+	std::string text_file;
+	std::string tree_dir;
+
+	bench_ctx_t( vm_state_t & vm, const size_t & src_id, const size_t & idx,
+		     const size_t & scale, const std::string & dir );
+	~bench_ctx_t();
+
+	var_base_t * call( nativefnptr_t fn, const std::vector< var_base_t * > & args );
+	var_base_t * str( const std::string & val );
+	var_base_t * num( const int64_t & val );
+};
+
+struct bench_case_t
+{
+	const char * name;
+	// runs one iteration and returns the nanoseconds spent in the measured part, -1 on failure
+	int64_t ( * run )( bench_ctx_t & ctx );
+};
+
+// static, so that they cannot clash with the symbols of the std modules the benchmarks link (os has a mono_ns)
+static int64_t mono_ns();
+static void release( var_base_t * var );
+static bench_result_t summarize( const std::string & name, const std::string & kind, std::vector< int64_t > & samples );
+static void print_result( const bench_result_t & res );
+static void generate_words( std::string & res, const size_t & bytes, const size_t & words_per_line, lcg_t & gen,
+			    size_t & count );
+static bool write_file( const std::string & file, const std::string & data );
+static bool make_tree( const std::string & dir, const size_t & depth, const size_t & files,
+		       std::vector< var_base_t * > & paths, const size_t & src_id, const size_t & idx );
+static bool read_results( const std::string & file, std::vector< bench_result_t > & res );
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////// Inputs ////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static var_base_t * words( bench_ctx_t & ctx )
+{
+	if( ctx.words == nullptr ) {
+		std::string data;
+		lcg_t gen( 1 );
+		size_t count = 0;
+		generate_words( data, BENCH_STR_BYTES * ctx.scale, 0, gen, count );
+		ctx.words = new var_str_t( data, ctx.src_id, ctx.idx );
+	}
+	return ctx.words;
+}
+
+static var_base_t * blob( bench_ctx_t & ctx )
+{
+	if( ctx.blob == nullptr ) {
+		std::string data;
+		data.reserve( BENCH_HASH_BYTES * ctx.scale );
+		lcg_t gen( 2 );
+		while( data.size() < BENCH_HASH_BYTES * ctx.scale ) data += ( char )gen.next();
+		ctx.blob = new var_str_t( data, ctx.src_id, ctx.idx );
+	}
+	return ctx.blob;
+}
+
+static var_base_t * ints( bench_ctx_t & ctx )
+{
+	if( ctx.ints == nullptr ) {
+		std::vector< var_base_t * > vec;
+		vec.reserve( BENCH_ELEMS * ctx.scale );
+		for( size_t i = 0; i < BENCH_ELEMS * ctx.scale; ++i ) {
+			vec.push_back( new var_int_t( ( long )i, ctx.src_id, ctx.idx ) );
+		}
+		ctx.ints = new var_vec_t( vec, ctx.src_id, ctx.idx );
+	}
+	return ctx.ints;
+}
+
+static var_base_t * keys( bench_ctx_t & ctx )
+{
+	if( ctx.keys == nullptr ) {
+		std::vector< var_base_t * > vec;
+		vec.reserve( BENCH_ELEMS * ctx.scale );
+		lcg_t gen( 3 );
+		for( size_t i = 0; i < BENCH_ELEMS * ctx.scale; ++i ) {
+			vec.push_back( new var_str_t( "key_" + std::to_string( gen.next() ) + "_" + std::to_string( i ),
+						      ctx.src_id, ctx.idx ) );
+		}
+		ctx.keys = new var_vec_t( vec, ctx.src_id, ctx.idx );
+	}
+	return ctx.keys;
+}
+
+static var_base_t * filled_map( bench_ctx_t & ctx )
+{
+	if( ctx.map == nullptr ) {
+		std::unordered_map< std::string, var_base_t * > map;
+		const std::vector< var_base_t * > & k = VEC( keys( ctx ) )->get();
+		map.reserve( k.size() );
+		for( size_t i = 0; i < k.size(); ++i ) {
+			map[ STR( k[ i ] )->get() ] = new var_int_t( ( long )i, ctx.src_id, ctx.idx );
+		}
+		ctx.map = new var_map_t( map, ctx.src_id, ctx.idx );
+	}
+	return ctx.map;
+}
+
+// generated and written in chunks, the file is much larger than anything else kept in memory
+static const std::string & text_file( bench_ctx_t & ctx )
+{
+	if( ctx.text_file.empty() ) {
+		ctx.text_file = ctx.dir + "/text.txt";
+		FILE * out = fopen( ctx.text_file.c_str(), "w" );
+		if( out == nullptr ) {
+			ctx.text_file.clear();
+			return ctx.text_file;
+		}
+		lcg_t gen( 4 );
+		size_t count = 0;
+		std::string chunk;
+		bool ok = true;
+		for( size_t written = 0; ok && written < BENCH_FILE_BYTES * ctx.scale; written += chunk.size() ) {
+			chunk.clear();
+			generate_words( chunk, std::min( BENCH_FILE_CHUNK_BYTES, BENCH_FILE_BYTES * ctx.scale - written ), 12,
+					gen, count );
+			ok = fwrite( chunk.data(), 1, chunk.size(), out ) == chunk.size();
+		}
+		if( fclose( out ) != 0 || !ok ) ctx.text_file.clear();
+	}
+	return ctx.text_file;
+}
+
+static var_base_t * tree_files( bench_ctx_t & ctx )
+{
+	if( ctx.tree_files == nullptr ) {
+		std::vector< var_base_t * > paths;
+		ctx.tree_dir = ctx.dir + "/tree";
+		make_tree( ctx.tree_dir, BENCH_TREE_DEPTH, BENCH_TREE_FILES * ctx.scale, paths, ctx.src_id, ctx.idx );
+		ctx.tree_files = new var_vec_t( paths, ctx.src_id, ctx.idx );
+	}
+	return ctx.tree_files;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////////// Cases /////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static int64_t bench_str_split( bench_ctx_t & ctx )
+{
+	var_base_t * str = words( ctx );
+	var_base_t * delim = ctx.str( " " );
+	int64_t start = mono_ns();
+	var_base_t * res = ctx.call( str_split, { str, delim } );
+	int64_t end = mono_ns();
+	release( res );
+	release( delim );
+	return res != nullptr ? end - start : -1;
+}
+
+static int64_t bench_vec_push( bench_ctx_t & ctx )
+{
+	var_base_t * vec = new var_vec_t( {}, ctx.src_id, ctx.idx );
+	var_base_t * val = ctx.num( 42 );
+	var_iref( val );
+	fn_data_t fd;
+	fd.src_id = ctx.src_id;
+	fd.idx = ctx.idx;
+	fd.args = { vec, val };
+	int64_t start = mono_ns();
+	for( size_t i = 0; i < BENCH_ELEMS * ctx.scale; ++i ) vec_push( ctx.vm, fd );
+	int64_t end = mono_ns();
+	var_dref( val );
+	var_dref( vec );
+	return end - start;
+}
+
+static int64_t bench_vec_at( bench_ctx_t & ctx )
+{
+	var_base_t * vec = ints( ctx );
+	const size_t count = VEC( vec )->get().size();
+	std::vector< var_base_t * > positions;
+	lcg_t gen( 5 );
+	for( size_t i = 0; i < count; ++i ) positions.push_back( var_iref( ctx.num( gen.next() % count ) ) );
+	fn_data_t fd;
+	fd.src_id = ctx.src_id;
+	fd.idx = ctx.idx;
+	fd.args = { vec, nullptr };
+	int64_t start = mono_ns();
+	for( auto & pos : positions ) {
+		fd.args[ 1 ] = pos;
+		vec_at( ctx.vm, fd );
+	}
+	int64_t end = mono_ns();
+	for( auto & pos : positions ) var_dref( pos );
+	return end - start;
+}
+
+static int64_t bench_map_insert( bench_ctx_t & ctx )
+{
+	const std::vector< var_base_t * > & k = VEC( keys( ctx ) )->get();
+	var_base_t * map = new var_map_t( {}, ctx.src_id, ctx.idx );
+	var_base_t * val = var_iref( ctx.num( 42 ) );
+	fn_data_t fd;
+	fd.src_id = ctx.src_id;
+	fd.idx = ctx.idx;
+	fd.args = { map, nullptr, val };
+	int64_t start = mono_ns();
+	for( auto & key : k ) {
+		fd.args[ 1 ] = key;
+		map_insert( ctx.vm, fd );
+	}
+	int64_t end = mono_ns();
+	var_dref( val );
+	var_dref( map );
+	return end - start;
+}
+
+static int64_t bench_map_get( bench_ctx_t & ctx )
+{
+	const std::vector< var_base_t * > & k = VEC( keys( ctx ) )->get();
+	var_base_t * map = filled_map( ctx );
+	fn_data_t fd;
+	fd.src_id = ctx.src_id;
+	fd.idx = ctx.idx;
+	fd.args = { map, nullptr };
+	int64_t start = mono_ns();
+	for( auto & key : k ) {
+		fd.args[ 1 ] = key;
+		map_get( ctx.vm, fd );
+	}
+	int64_t end = mono_ns();
+	return end - start;
+}
+
+static int64_t bench_fs_read_all( bench_ctx_t & ctx )
+{
+	if( text_file( ctx ).empty() ) return -1;
+	var_base_t * file = ctx.str( text_file( ctx ) );
+	int64_t start = mono_ns();
+	var_base_t * res = ctx.call( fs_read_all, { ctx.vm.nil, file } );
+	int64_t end = mono_ns();
+	release( res );
+	release( file );
+	return res != nullptr ? end - start : -1;
+}
+
+static int64_t bench_fs_lines( bench_ctx_t & ctx )
+{
+	if( text_file( ctx ).empty() ) return -1;
+	FILE * f = fopen( text_file( ctx ).c_str(), "r" );
+	if( f == nullptr ) return -1;
+	var_base_t * file = new var_file_t( f, "r", ctx.src_id, ctx.idx );
+	int64_t start = mono_ns();
+	var_base_t * res = ctx.call( fs_file_lines, { file } );
+	int64_t end = mono_ns();
+	release( res );
+	var_dref( file );
+	return res != nullptr ? end - start : -1;
+}
+
+static int64_t bench_fs_mmap_lines( bench_ctx_t & ctx )
+{
+	if( text_file( ctx ).empty() ) return -1;
+	var_base_t * file = ctx.str( text_file( ctx ) );
+	int64_t start = mono_ns();
+	var_base_t * mm = ctx.call( fs_mmap, { ctx.vm.nil, file } );
+	var_base_t * res = mm != nullptr ? ctx.call( fs_mmap_line_count, { mm } ) : nullptr;
+	int64_t end = mono_ns();
+	release( res );
+	release( mm );
+	release( file );
+	return res != nullptr ? end - start : -1;
+}
+
+static int64_t bench_fs_walk( bench_ctx_t & ctx )
+{
+	tree_files( ctx );
+	var_base_t * dir = ctx.str( ctx.tree_dir );
+	var_base_t * glob = ctx.str( "*" );
+	var_base_t * mode = ctx.num( 1 ); // WALK_FILES
+	var_base_t * depth = ctx.num( -1 );
+	var_base_t * threads = ctx.num( 0 );
+	int64_t start = mono_ns();
+	var_base_t * walker = ctx.call( fs_walk, { ctx.vm.nil, dir, glob, mode, depth, ctx.vm.fals, threads } );
+	if( walker != nullptr ) {
+		var_iref( walker );
+		var_base_t * entry = nullptr;
+		while( ( entry = ctx.call( fs_walker_next, { walker } ) ) != ctx.vm.nil && entry != nullptr ) {
+			release( entry );
+		}
+	}
+	int64_t end = mono_ns();
+	if( walker != nullptr ) var_dref( walker );
+	for( auto & arg : { dir, glob, mode, depth, threads } ) release( arg );
+	return walker != nullptr ? end - start : -1;
+}
+
+static int64_t bench_fs_stat_many( bench_ctx_t & ctx )
+{
+	var_base_t * paths = tree_files( ctx );
+	var_base_t * threads = ctx.num( 0 );
+	int64_t start = mono_ns();
+	var_base_t * res = ctx.call( fs_stat_many, { ctx.vm.nil, paths, ctx.vm.fals, threads } );
+	int64_t end = mono_ns();
+	release( res );
+	release( threads );
+	return res != nullptr ? end - start : -1;
+}
+
+static int64_t bench_hash( bench_ctx_t & ctx, const char * algo_name )
+{
+	var_base_t * algo = ctx.str( algo_name );
+	int64_t start = mono_ns();
+	var_base_t * res = ctx.call( hash_str, { ctx.vm.nil, blob( ctx ), algo } );
+	int64_t end = mono_ns();
+	release( res );
+	release( algo );
+	return res != nullptr ? end - start : -1;
+}
+
+static int64_t bench_hash_xxh64( bench_ctx_t & ctx ) { return bench_hash( ctx, "xxh64" ); }
+static int64_t bench_hash_crc32c( bench_ctx_t & ctx ) { return bench_hash( ctx, "crc32c" ); }
+static int64_t bench_hash_sha256( bench_ctx_t & ctx ) { return bench_hash( ctx, "sha256" ); }
+
+static int64_t bench_os_copy( bench_ctx_t & ctx )
+{
+	tree_files( ctx );
+	var_base_t * src = ctx.str( ctx.tree_dir );
+	var_base_t * dest = ctx.str( ctx.dir + "/tree_copy" );
+	int64_t start = mono_ns();
+	var_base_t * res = ctx.call( os_copy, { ctx.vm.nil, src, dest } );
+	int64_t end = mono_ns();
+	release( ctx.call( os_rm, { ctx.vm.nil, dest } ) );
+	const bool ok = res != nullptr && res->type() == VT_VEC && VEC( res )->get().empty();
+	release( res );
+	release( src );
+	release( dest );
+	return ok ? end - start : -1;
+}
+
+static const bench_case_t bench_cases[] = {
+	{ "str.split", bench_str_split },
+	{ "vec.push", bench_vec_push },
+	{ "vec.at", bench_vec_at },
+	{ "map.insert", bench_map_insert },
+	{ "map.get", bench_map_get },
+	{ "fs.read_all", bench_fs_read_all },
+	{ "fs.lines", bench_fs_lines },
+	{ "fs.mmap_line_count", bench_fs_mmap_lines },
+	{ "fs.walk", bench_fs_walk },
+	{ "fs.stat_many", bench_fs_stat_many },
+	{ "hash.xxh64", bench_hash_xxh64 },
+	{ "hash.crc32c", bench_hash_crc32c },
+	{ "hash.sha256", bench_hash_sha256 },
+	{ "os.copy", bench_os_copy },
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////// Functions ///////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// runs the microbenchmarks whose names contain the filter, each for iters iterations (after one warmup)
+// the inputs are generated in dir (created and removed here) and scale linearly with scale
+// returns the number of failed benchmarks
+var_base_t * bench_run( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		src->fail( fd.idx, "expected string argument for filter, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 2 ]->type() != VT_INT || fd.args[ 3 ]->type() != VT_INT ) {
+		src->fail( fd.idx, "expected int arguments for scale and iterations, found: %s, %s",
+			   vm.type_name( fd.args[ 2 ]->type() ).c_str(), vm.type_name( fd.args[ 3 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 4 ]->type() != VT_STR ) {
+		src->fail( fd.idx, "expected string argument for scratch directory, found: %s",
+			   vm.type_name( fd.args[ 4 ]->type() ).c_str() );
+		return nullptr;
+	}
+	const std::string & filter = STR( fd.args[ 1 ] )->get();
+	const long scale = INT( fd.args[ 2 ] )->get().get_si();
+	const long iters = INT( fd.args[ 3 ] )->get().get_si();
+	const std::string & dir = STR( fd.args[ 4 ] )->get();
+	if( scale < 1 || iters < 1 ) {
+		src->fail( fd.idx, "scale and iterations must be positive, found: %ld, %ld", scale, iters );
+		return nullptr;
+	}
+	if( mkdir( dir.c_str(), 0755 ) != 0 && errno != EEXIST ) {
+		src->fail( fd.idx, "failed to create scratch directory: %s, error: %s", dir.c_str(), strerror( errno ) );
+		return nullptr;
+	}
+	bench_ctx_t ctx( vm, fd.src_id, fd.idx, scale, dir );
+	size_t failed = 0;
+	for( auto & bc : bench_cases ) {
+		if( !filter.empty() && strstr( bc.name, filter.c_str() ) == nullptr ) continue;
+		std::vector< int64_t > samples;
+		bool ok = bc.run( ctx ) >= 0;
+		for( long i = 0; ok && i < iters; ++i ) {
+			const int64_t ns = bc.run( ctx );
+			if( ns < 0 ) ok = false;
+			samples.push_back( ns );
+		}
+		if( !ok ) {
+			fprintf( stderr, "%-24s failed\n", bc.name );
+			++failed;
+			continue;
+		}
+		results.push_back( summarize( bc.name, "micro", samples ) );
+		print_result( results.back() );
+	}
+	return make< var_int_t >( failed );
+}
+
+// records the samples (vector of nanosecond ints) of a macro benchmark
+var_base_t * bench_record( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		src->fail( fd.idx, "expected string argument for name, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 2 ]->type() != VT_VEC || VEC( fd.args[ 2 ] )->get().empty() ) {
+		src->fail( fd.idx, "expected a non empty vector argument for samples, found: %s",
+			   vm.type_name( fd.args[ 2 ]->type() ).c_str() );
+		return nullptr;
+	}
+	std::vector< int64_t > samples;
+	for( auto & e : VEC( fd.args[ 2 ] )->get() ) {
+		if( e->type() != VT_INT ) {
+			src->fail( fd.idx, "expected vector of ints for samples, found element: %s",
+				   vm.type_name( e->type() ).c_str() );
+			return nullptr;
+		}
+		samples.push_back( INT( e )->get().get_si() );
+	}
+	results.push_back( summarize( STR( fd.args[ 1 ] )->get(), "macro", samples ) );
+	print_result( results.back() );
+	return vm.nil;
+}
+
+var_base_t * bench_write_json( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		src->fail( fd.idx, "expected string argument for file, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	const std::string & file = STR( fd.args[ 1 ] )->get();
+	FILE * out = fopen( file.c_str(), "w" );
+	if( out == nullptr ) {
+		src->fail( fd.idx, "failed to open file: %s, error: %s", file.c_str(), strerror( errno ) );
+		return nullptr;
+	}
+	fprintf( out, "{\n  \"results\": [\n" );
+	for( size_t i = 0; i < results.size(); ++i ) {
+		const bench_result_t & r = results[ i ];
+		fprintf( out, "    { \"name\": \"%s\", \"kind\": \"%s\", \"iters\": %zu, \"min_ns\": %lld, "
+			 "\"median_ns\": %lld, \"mean_ns\": %lld, \"max_ns\": %lld }%s\n",
+			 r.name.c_str(), r.kind.c_str(), r.iters, ( long long )r.min_ns, ( long long )r.median_ns,
+			 ( long long )r.mean_ns, ( long long )r.max_ns, i + 1 < results.size() ? "," : "" );
+	}
+	fprintf( out, "  ]\n}\n" );
+	if( fclose( out ) != 0 ) {
+		src->fail( fd.idx, "failed to write file: %s, error: %s", file.c_str(), strerror( errno ) );
+		return nullptr;
+	}
+	return vm.nil;
+}
+
+// compares the medians of two result files, printing a line per benchmark of the current file
+// returns the number of benchmarks slower than the baseline by more than threshold percent
+var_base_t * bench_compare( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_STR || fd.args[ 2 ]->type() != VT_STR ) {
+		src->fail( fd.idx, "expected string arguments for baseline and current files, found: %s, %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str(), vm.type_name( fd.args[ 2 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 3 ]->type() != VT_INT ) {
+		src->fail( fd.idx, "expected int argument for threshold percentage, found: %s",
+			   vm.type_name( fd.args[ 3 ]->type() ).c_str() );
+		return nullptr;
+	}
+	std::vector< bench_result_t > base, curr;
+	for( auto & f : { std::make_pair( fd.args[ 1 ], & base ), std::make_pair( fd.args[ 2 ], & curr ) } ) {
+		if( !read_results( STR( f.first )->get(), * f.second ) ) {
+			src->fail( fd.idx, "failed to read benchmark results from: %s", STR( f.first )->get().c_str() );
+			return nullptr;
+		}
+	}
+	const long threshold = INT( fd.args[ 3 ] )->get().get_si();
+	size_t regressions = 0;
+	for( auto & c : curr ) {
+		auto b = std::find_if( base.begin(), base.end(), [ & c ]( const bench_result_t & r ) { return r.name == c.name; } );
+		if( b == base.end() ) {
+			fprintf( stdout, "%-24s %14s %14lld %9s  new\n", c.name.c_str(), "-", ( long long )c.median_ns, "-" );
+			continue;
+		}
+		const int64_t delta = c.median_ns - b->median_ns;
+		const double pct = b->median_ns > 0 ? 100.0 * delta / b->median_ns : 0.0;
+		const char * verdict = "";
+		if( pct > threshold && delta >= BENCH_MIN_DELTA_NS ) {
+			verdict = "REGRESSION";
+			++regressions;
+		} else if( pct < -threshold && -delta >= BENCH_MIN_DELTA_NS ) {
+			verdict = "improved";
+		}
+		fprintf( stdout, "%-24s %14lld %14lld %+8.1f%%  %s\n", c.name.c_str(), ( long long )b->median_ns,
+			 ( long long )c.median_ns, pct, verdict );
+	}
+	return make< var_int_t >( regressions );
+}
+
+// parses the leading (optionally signed, whitespace prefixed) integer of a string
+var_base_t * bench_parse_int( vm_state_t & vm, const fn_data_t & fd )
+{
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected string argument to parse, found: %s",
+						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	return make< var_int_t >( strtol( STR( fd.args[ 1 ] )->get().c_str(), NULL, 10 ) );
+}
+
+// true if the string contains the part (always for an empty part)
+var_base_t * bench_contains( vm_state_t & vm, const fn_data_t & fd )
+{
+	if( fd.args[ 1 ]->type() != VT_STR || fd.args[ 2 ]->type() != VT_STR ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected string arguments, found: %s, %s",
+						  vm.type_name( fd.args[ 1 ]->type() ).c_str(),
+						  vm.type_name( fd.args[ 2 ]->type() ).c_str() );
+		return nullptr;
+	}
+	return STR( fd.args[ 1 ] )->get().find( STR( fd.args[ 2 ] )->get() ) != std::string::npos ? vm.tru : vm.fals;
+}
+
+INIT_MODULE( bench )
+{
+	var_src_t * src = vm.src_stack.back();
+	src->add_nativefn( "run_native", bench_run, 4 );
+	src->add_nativefn( "record", bench_record, 2 );
+	src->add_nativefn( "write_json", bench_write_json, 1 );
+	src->add_nativefn( "compare_native", bench_compare, 3 );
+	src->add_nativefn( "parse_int", bench_parse_int, 1 );
+	src->add_nativefn( "contains", bench_contains, 2 );
+	return true;
+}
+
+lcg_t::lcg_t( const uint64_t & seed ) : state( seed ) {}
+uint32_t lcg_t::next()
+{
+	state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+	return state >> 33;
+}
+
+bench_ctx_t::bench_ctx_t( vm_state_t & vm, const size_t & src_id, const size_t & idx,
+			  const size_t & scale, const std::string & dir )
+	: vm( vm ), src_id( src_id ), idx( idx ), scale( scale ), dir( dir ), words( nullptr ),
+	  blob( nullptr ), ints( nullptr ), keys( nullptr ), map( nullptr ), tree_files( nullptr ) {}
+bench_ctx_t::~bench_ctx_t()
+{
+	for( auto var : { words, blob, ints, keys, map, tree_files } ) {
+		if( var != nullptr ) var_dref( var );
+	}
+	var_base_t * path = str( dir );
+	release( call( os_rm, { vm.nil, path } ) );
+	release( path );
+}
+
+var_base_t * bench_ctx_t::call( nativefnptr_t fn, const std::vector< var_base_t * > & args )
+{
+	fn_data_t fd;
+	fd.src_id = src_id;
+	fd.idx = idx;
+	fd.args = args;
+	return fn( vm, fd );
+}
+
+var_base_t * bench_ctx_t::str( const std::string & val ) { return make< var_str_t >( val ); }
+var_base_t * bench_ctx_t::num( const int64_t & val ) { return make< var_int_t >( ( long )val ); }
+
+static int64_t mono_ns()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, & ts );
+	return ( int64_t )ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// frees a result of a native call, if nothing else holds it
+static void release( var_base_t * var )
+{
+	if( var == nullptr ) return;
+	var_iref( var );
+	var_dref( var );
+}
+
+static bench_result_t summarize( const std::string & name, const std::string & kind, std::vector< int64_t > & samples )
+{
+	std::sort( samples.begin(), samples.end() );
+	int64_t sum = 0;
+	for( auto & s : samples ) sum += s;
+	const size_t n = samples.size();
+	const int64_t median = n % 2 ? samples[ n / 2 ] : ( samples[ n / 2 - 1 ] + samples[ n / 2 ] ) / 2;
+	return { name, kind, n, samples.front(), median, sum / ( int64_t )n, samples.back() };
+}
+
+static void print_result( const bench_result_t & res )
+{
+	fprintf( stdout, "%-24s %6s  median: %12.3f ms  min: %12.3f ms  iters: %zu\n", res.name.c_str(), res.kind.c_str(),
+		 res.median_ns / 1e6, res.min_ns / 1e6, res.iters );
+	fflush( stdout );
+}
+
+// appends lowercase words of 1 to 12 letters separated by spaces, and newlines every words_per_line words
+// (if not 0), until res has at least bytes - gen and count (of words so far) carry over between calls
+static void generate_words( std::string & res, const size_t & bytes, const size_t & words_per_line, lcg_t & gen,
+			    size_t & count )
+{
+	res.reserve( bytes + 16 );
+	while( res.size() < bytes ) {
+		const size_t len = 1 + gen.next() % 12;
+		for( size_t i = 0; i < len; ++i ) res += ( char )( 'a' + gen.next() % 26 );
+		++count;
+		res += words_per_line > 0 && count % words_per_line == 0 ? '\n' : ' ';
+	}
+}
+
+static bool write_file( const std::string & file, const std::string & data )
+{
+	FILE * out = fopen( file.c_str(), "w" );
+	if( out == nullptr ) return false;
+	const bool ok = fwrite( data.data(), 1, data.size(), out ) == data.size();
+	return fclose( out ) == 0 && ok;
+}
+
+// depth levels of BENCH_TREE_FANOUT sub directories, each directory containing files small files
+static bool make_tree( const std::string & dir, const size_t & depth, const size_t & files,
+		       std::vector< var_base_t * > & paths, const size_t & src_id, const size_t & idx )
+{
+	if( mkdir( dir.c_str(), 0755 ) != 0 && errno != EEXIST ) return false;
+	for( size_t i = 0; i < files; ++i ) {
+		const std::string file = dir + "/file_" + std::to_string( i ) + ".txt";
+		if( !write_file( file, file ) ) return false;
+		paths.push_back( new var_str_t( file, src_id, idx ) );
+	}
+	if( depth == 0 ) return true;
+	for( size_t i = 0; i < BENCH_TREE_FANOUT; ++i ) {
+		if( !make_tree( dir + "/dir_" + std::to_string( i ), depth - 1, files, paths, src_id, idx ) ) return false;
+	}
+	return true;
+}
+
+// reads the results of a file written by bench_write_json - it only understands that layout:
+// one result object per line, with string and integer values
+static bool read_results( const std::string & file, std::vector< bench_result_t > & res )
+{
+	FILE * in = fopen( file.c_str(), "r" );
+	if( in == nullptr ) return false;
+	char * line = NULL;
+	size_t len = 0;
+	ssize_t read;
+	while( ( read = getline( & line, & len, in ) ) != -1 ) {
+		std::string l( line, read );
+		if( l.find( "\"name\"" ) == std::string::npos ) continue;
+		bench_result_t r = { "", "", 0, 0, 0, 0, 0 };
+		auto str_field = [ & l ]( const char * key ) {
+			size_t pos = l.find( std::string( "\"" ) + key + "\": \"" );
+			if( pos == std::string::npos ) return std::string();
+			pos += strlen( key ) + 5;
+			return l.substr( pos, l.find( '"', pos ) - pos );
+		};
+		auto int_field = [ & l ]( const char * key ) {
+			size_t pos = l.find( std::string( "\"" ) + key + "\": " );
+			if( pos == std::string::npos ) return ( int64_t )-1;
+			return ( int64_t )strtoll( l.c_str() + pos + strlen( key ) + 4, NULL, 10 );
+		};
+		r.name = str_field( "name" );
+		r.kind = str_field( "kind" );
+		r.iters = int_field( "iters" );
+		r.min_ns = int_field( "min_ns" );
+		r.median_ns = int_field( "median_ns" );
+		r.mean_ns = int_field( "mean_ns" );
+		r.max_ns = int_field( "max_ns" );
+		if( r.name.empty() || r.median_ns < 0 ) continue;
+		res.push_back( r );
+	}
+	free( line );
+	fclose( in );
+	return true;
+}
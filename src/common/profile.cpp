@@ -0,0 +1,171 @@
+/*
+	Copyright (c) 2020, Electrux
+	All rights reserved.
+	Using the BSD 3-Clause license for the project,
+	main LICENSE file resides in project's root directory.
+	Please read that file and understand the license terms
+	before using or altering the project.
+*/
+
+#include <ctime>
+#include <deque>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+
+#include "profile.hpp"
+
+struct prof_fn_t
+{
+	std::string name;
+	uint64_t calls;
+	int64_t total_ns;
+	int64_t self_ns;
+	uint64_t result_bytes;
+};
+
+// call tree of the natives, for the folded stacks
+struct prof_node_t
+{
+	prof_fn_t * fn;
+	int64_t self_ns;
+	std::unordered_map< prof_fn_t *, prof_node_t * > children;
+
+	prof_node_t( prof_fn_t * f );
+	~prof_node_t();
+};
+
+prof_node_t::prof_node_t( prof_fn_t * f ) : fn( f ), self_ns( 0 ) {}
+prof_node_t::~prof_node_t()
+{
+	for( auto & c : children ) delete c.second;
+}
+
+struct prof_frame_t
+{
+	prof_fn_t * fn;
+	prof_node_t * node;
+	int64_t start;
+	int64_t child_ns;
+};
+
+// natives only ever run on the interpreter thread, so none of this is locked
+static int installed = -1;
+static bool active = false;
+static std::deque< prof_fn_t > fns;
+static prof_node_t root( nullptr );
+static std::vector< prof_frame_t > frames;
+
+// CLOCK_MONOTONIC is read through the vDSO, without a system call
+static inline int64_t prof_now()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, & ts );
+	return ( int64_t )ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+bool prof_installed()
+{
+	if( installed < 0 ) {
+		const char * env = getenv( "FERAL_STD_PROFILE" );
+		installed = env != nullptr && * env != '\0';
+		active = installed && strcmp( env, "0" ) != 0;
+	}
+	return installed;
+}
+
+prof_fn_t * prof_register( const char * name )
+{
+	fns.push_back( { name, 0, 0, 0, 0 } );
+	return & fns.back();
+}
+
+void prof_enter( prof_fn_t * fn )
+{
+	if( !active ) return;
+	prof_node_t * parent = frames.empty() ? & root : frames.back().node;
+	prof_node_t *& node = parent->children[ fn ];
+	if( node == nullptr ) node = new prof_node_t( fn );
+	frames.push_back( { fn, node, prof_now(), 0 } );
+}
+
+// approximate size of the result, if it was created by the call
+static uint64_t result_bytes( vm_state_t & vm, const fn_data_t & fd, var_base_t * res )
+{
+	if( res == nullptr || res == vm.nil || res == vm.tru || res == vm.fals ) return 0;
+	for( auto & arg : fd.args ) {
+		if( arg == res ) return 0;
+	}
+	switch( res->type() ) {
+	case VT_STR: return sizeof( var_str_t ) + STR( res )->get().capacity();
+	case VT_VEC: return sizeof( var_vec_t ) + VEC( res )->get().capacity() * sizeof( var_base_t * );
+	case VT_MAP: return sizeof( var_map_t ) + MAP( res )->get().size() * ( sizeof( std::string ) + 2 * sizeof( void * ) );
+	default: return sizeof( var_base_t );
+	}
+}
+
+void prof_exit( prof_fn_t * fn, vm_state_t & vm, const fn_data_t & fd, var_base_t * res )
+{
+	// calls which started before the profiler did are not recorded
+	if( frames.empty() || frames.back().fn != fn ) return;
+	prof_frame_t frame = frames.back();
+	frames.pop_back();
+	const int64_t elapsed = prof_now() - frame.start;
+	++fn->calls;
+	fn->total_ns += elapsed;
+	fn->self_ns += elapsed - frame.child_ns;
+	fn->result_bytes += result_bytes( vm, fd, res );
+	frame.node->self_ns += elapsed - frame.child_ns;
+	if( !frames.empty() ) frames.back().child_ns += elapsed;
+}
+
+bool prof_start()
+{
+	if( !prof_installed() ) return false;
+	active = true;
+	return true;
+}
+
+void prof_stop()
+{
+	active = false;
+	frames.clear();
+}
+
+void prof_reset()
+{
+	for( auto & fn : fns ) fn.calls = fn.total_ns = fn.self_ns = fn.result_bytes = 0;
+	for( auto & c : root.children ) delete c.second;
+	root.children.clear();
+	frames.clear();
+}
+
+std::vector< prof_stats_t > prof_stats()
+{
+	std::vector< prof_stats_t > res;
+	for( auto & fn : fns ) {
+		if( fn.calls == 0 ) continue;
+		res.push_back( { fn.name, fn.calls, fn.total_ns, fn.self_ns, fn.result_bytes } );
+	}
+	return res;
+}
+
+bool prof_write_folded( const std::string & file )
+{
+	FILE * out = fopen( file.c_str(), "w" );
+	if( out == nullptr ) return false;
+	std::string stack;
+	std::function< void( const prof_node_t * ) > walk = [ & ]( const prof_node_t * node ) {
+		const size_t len = stack.size();
+		if( node->fn != nullptr ) {
+			if( !stack.empty() ) stack += ';';
+			stack += node->fn->name;
+			if( node->self_ns > 0 ) fprintf( out, "%s %lld\n", stack.c_str(), ( long long )node->self_ns );
+		}
+		for( auto & c : node->children ) walk( c.second );
+		stack.resize( len );
+	};
+	walk( & root );
+	return fclose( out ) == 0;
+}
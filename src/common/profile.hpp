@@ -0,0 +1,74 @@
+/*
+	Copyright (c) 2020, Electrux
+	All rights reserved.
+	Using the BSD 3-Clause license for the project,
+	main LICENSE file resides in project's root directory.
+	Please read that file and understand the license terms
+	before using or altering the project.
+*/
+
+#ifndef FERAL_STD_COMMON_PROFILE_HPP
+#define FERAL_STD_COMMON_PROFILE_HPP
+
+#include <feral/VM/VM.hpp>
+
+// native function call profiler shared by all the std modules
+// the natives are only wrapped when the FERAL_STD_PROFILE environment variable is set
+// (1: record from the start, 0: record from sys.profile_start()) when a module is loaded,
+// otherwise they are registered as they are, with no overhead at all
+
+typedef var_base_t * ( * prof_native_t )( vm_state_t & vm, const fn_data_t & fd );
+
+struct prof_fn_t;
+
+bool prof_installed();
+prof_fn_t * prof_register( const char * name );
+void prof_enter( prof_fn_t * fn );
+void prof_exit( prof_fn_t * fn, vm_state_t & vm, const fn_data_t & fd, var_base_t * res );
+
+// starts / stops recording, start returns false if the natives are not wrapped
+bool prof_start();
+void prof_stop();
+void prof_reset();
+
+struct prof_stats_t
+{
+	std::string name;
+	uint64_t calls;
+	int64_t total_ns;
+	int64_t self_ns;
+	uint64_t result_bytes;
+};
+std::vector< prof_stats_t > prof_stats();
+// writes the native call stacks in the folded format of flamegraph.pl (weights are self ns)
+bool prof_write_folded( const std::string & file );
+
+template< prof_native_t F >
+struct prof_slot_t
+{
+	static prof_fn_t * fn;
+};
+template< prof_native_t F > prof_fn_t * prof_slot_t< F >::fn = nullptr;
+
+template< prof_native_t F >
+var_base_t * prof_wrap( vm_state_t & vm, const fn_data_t & fd )
+{
+	prof_fn_t * fn = prof_slot_t< F >::fn;
+	prof_enter( fn );
+	var_base_t * res = F( vm, fd );
+	prof_exit( fn, vm, fd, res );
+	return res;
+}
+
+template< prof_native_t F >
+prof_native_t prof_select( const char * name )
+{
+	if( !prof_installed() ) return F;
+	prof_slot_t< F >::fn = prof_register( name );
+	return prof_wrap< F >;
+}
+
+// use on the native function given to add_nativefn / add_typefn_native
+#define PROF( fn ) prof_select< fn >( #fn )
+
+#endif // FERAL_STD_COMMON_PROFILE_HPP
@@ -0,0 +1,26 @@
+/*
+	Copyright (c) 2020, Electrux
+	All rights reserved.
+	Using the BSD 3-Clause license for the project,
+	main LICENSE file resides in project's root directory.
+	Please read that file and understand the license terms
+	before using or altering the project.
+*/
+
+#ifndef FERAL_STD_COMMON_STAT_HPP
+#define FERAL_STD_COMMON_STAT_HPP
+
+#include <cstdint>
+#include <sys/stat.h>
+
+// modification time of the stat result in ns (macOS names the member st_mtimespec)
+static inline int64_t mtime_ns( const struct stat & st )
+{
+#if defined( __APPLE__ )
+	return ( int64_t )st.st_mtimespec.tv_sec * 1000000000 + st.st_mtimespec.tv_nsec;
+#else
+	return ( int64_t )st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+#endif
+}
+
+#endif // FERAL_STD_COMMON_STAT_HPP
@@ -7,14 +7,34 @@
 	before using or altering the project.
 */
 
+#include <set>
+#include <deque>
+#include <mutex>
 #include <regex>
+#include <atomic>
+#include <cerrno>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
 
+#include <fcntl.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
+#if __linux__
+#include <sys/inotify.h>
+#endif
 
 #include <feral/VM/VM.hpp>
 
+#include "common/profile.hpp"
+#include "common/stat.hpp"
+
 enum WalkEntry {
 	FILES = 1 << 0,
 	DIRS = 1 << 1,
@@ -29,14 +49,31 @@ void get_entries_internal( const std::string & dir_str, std::vector< var_base_t
 ///////////////////////////////////////////////////////////// Classes //////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
+// default size of the read buffer owned by each file iterable
+const size_t FILE_ITERABLE_BUF_SIZE = 64 * 1024;
+// file read, read_into and pread grow their result by at most this much at a time
+const size_t FILE_READ_CHUNK_SIZE = 1024 * 1024;
+
 // initialize this in the init_fs function
 static int file_iterable_typeid;
 
+// iterates over the records of a file separated by a delimiter, reading the file
+// in blocks in its own buffer and reusing one string for the record being built
+// with the default delimiter ('\n'), trailing carriage returns are removed as well
 class var_file_iterable_t : public var_base_t
 {
 	var_file_t * m_file;
+	std::vector< char > m_buf;
+	size_t m_beg;
+	size_t m_end;
+	bool m_eof;
+	std::string m_delim;
+	std::string m_rec;
+
+	bool fill();
 public:
-	var_file_iterable_t( var_file_t * file, const size_t & src_id, const size_t & idx );
+	var_file_iterable_t( var_file_t * file, const size_t & buf_size, const std::string & delim,
+			     const size_t & src_id, const size_t & idx );
 	~var_file_iterable_t();
 
 	var_base_t * copy( const size_t & src_id, const size_t & idx );
@@ -46,54 +83,1638 @@ public:
 };
 #define FILE_ITERABLE( x ) static_cast< var_file_iterable_t * >( x )
 
-var_file_iterable_t::var_file_iterable_t( var_file_t * file, const size_t & src_id, const size_t & idx )
-	: var_base_t( file_iterable_typeid, src_id, idx ), m_file( file )
+var_file_iterable_t::var_file_iterable_t( var_file_t * file, const size_t & buf_size, const std::string & delim,
+					  const size_t & src_id, const size_t & idx )
+	: var_base_t( file_iterable_typeid, src_id, idx ), m_file( file ),
+	  m_buf( std::max( buf_size, delim.size() ) ), m_beg( 0 ), m_end( 0 ), m_eof( false ), m_delim( delim )
+{
+	var_iref( m_file );
+}
+var_file_iterable_t::~var_file_iterable_t() { var_dref( m_file ); }
+
+var_base_t * var_file_iterable_t::copy( const size_t & src_id, const size_t & idx )
+{
+	var_file_iterable_t * it = new var_file_iterable_t( m_file, m_buf.size(), m_delim, src_id, idx );
+	it->set( this );
+	return it;
+}
+void var_file_iterable_t::set( var_base_t * from )
+{
+	var_file_iterable_t * it = FILE_ITERABLE( from );
+	var_dref( m_file );
+	m_file = it->m_file;
+	var_iref( m_file );
+	m_buf = it->m_buf;
+	m_beg = it->m_beg;
+	m_end = it->m_end;
+	m_eof = it->m_eof;
+	m_delim = it->m_delim;
+}
+
+// moves the unconsumed bytes to the front and reads more after them
+bool var_file_iterable_t::fill()
+{
+	if( m_eof ) return false;
+	if( m_beg > 0 ) {
+		memmove( m_buf.data(), m_buf.data() + m_beg, m_end - m_beg );
+		m_end -= m_beg;
+		m_beg = 0;
+	}
+	size_t len = fread( m_buf.data() + m_end, 1, m_buf.size() - m_end, m_file->get() );
+	if( len == 0 ) {
+		m_eof = true;
+		return false;
+	}
+	m_end += len;
+	return true;
+}
+
+bool var_file_iterable_t::next( var_base_t * & val )
+{
+	if( m_beg == m_end && !fill() ) return false;
+
+	const char * buf = m_buf.data();
+	const size_t dlen = m_delim.size();
+	size_t scan = m_beg;
+	m_rec.clear();
+	while( true ) {
+		const char * p = ( const char * )memchr( buf + scan, m_delim[ 0 ], m_end - scan );
+		size_t pos = p == nullptr ? m_end : p - buf;
+		if( p != nullptr && pos + dlen <= m_end ) {
+			if( memcmp( p, m_delim.data(), dlen ) != 0 ) {
+				scan = pos + 1;
+				continue;
+			}
+			m_rec.append( buf + m_beg, pos - m_beg );
+			m_beg = pos + dlen;
+			break;
+		}
+		// no complete delimiter in the buffer, a partial one at its end is kept
+		// for after the refill since it may continue in the next block
+		m_rec.append( buf + m_beg, pos - m_beg );
+		m_beg = pos;
+		if( !fill() ) {
+			m_rec.append( buf + m_beg, m_end - m_beg );
+			m_beg = m_end;
+			break;
+		}
+		scan = m_beg;
+	}
+	if( m_delim == "\n" ) {
+		while( !m_rec.empty() && m_rec.back() == '\r' ) m_rec.pop_back();
+	}
+	val = make< var_str_t >( m_rec );
+	return true;
+}
+
+// default size of the window in which blocks are looked for
+const size_t BLOCK_SCAN_WINDOW_SIZE = 1024 * 1024;
+
+// Boyer-Moore-Horspool matcher, the skip table is computed once per pattern
+class bmh_t
+{
+	std::string m_pat;
+	size_t m_skip[ 256 ];
+public:
+	bmh_t( const std::string & pat );
+
+	// position of the first match in data, len if there is none
+	size_t find( const char * data, const size_t & len ) const;
+	inline size_t size() const { return m_pat.size(); }
+};
+
+bmh_t::bmh_t( const std::string & pat ) : m_pat( pat )
+{
+	const size_t m = m_pat.size();
+	for( auto & skip : m_skip ) skip = m;
+	for( size_t j = 0; j + 1 < m; ++j ) m_skip[ ( unsigned char )m_pat[ j ] ] = m - 1 - j;
+}
+
+size_t bmh_t::find( const char * data, const size_t & len ) const
+{
+	const size_t m = m_pat.size();
+	if( m == 1 ) {
+		const char * p = ( const char * )memchr( data, m_pat[ 0 ], len );
+		return p == nullptr ? len : p - data;
+	}
+	if( len < m ) return len;
+	const char * pat = m_pat.data();
+	const unsigned char last = pat[ m - 1 ];
+	for( size_t i = 0; i <= len - m; ) {
+		const unsigned char c = data[ i + m - 1 ];
+		if( c == last && memcmp( data + i, pat, m - 1 ) == 0 ) return i;
+		i += m_skip[ c ];
+	}
+	return len;
+}
+
+// extracts the contents between begin and end markers from a file, scanning it
+// in fixed size windows - the tail of a window which may hold the beginning of a
+// marker is carried over to the next one so markers can span window boundaries
+class block_scanner_t
+{
+	std::vector< char > m_buf;
+	size_t m_beg;
+	size_t m_end;
+	bool m_eof;
+	bool m_inside;
+	bmh_t m_begin;
+	bmh_t m_close;
+
+	bool fill( FILE * file );
+public:
+	block_scanner_t( const std::string & begin, const std::string & end, const size_t & window );
+
+	// false when there are no more (complete) blocks
+	bool next( FILE * file, std::string & block );
+};
+
+block_scanner_t::block_scanner_t( const std::string & begin, const std::string & end, const size_t & window )
+	: m_buf( window + std::max( begin.size(), end.size() ) ), m_beg( 0 ), m_end( 0 ),
+	  m_eof( false ), m_inside( false ), m_begin( begin ), m_close( end ) {}
+
+bool block_scanner_t::fill( FILE * file )
+{
+	if( m_eof ) return false;
+	if( m_beg > 0 ) {
+		memmove( m_buf.data(), m_buf.data() + m_beg, m_end - m_beg );
+		m_end -= m_beg;
+		m_beg = 0;
+	}
+	size_t len = fread( m_buf.data() + m_end, 1, m_buf.size() - m_end, file );
+	if( len == 0 ) {
+		m_eof = true;
+		return false;
+	}
+	m_end += len;
+	return true;
+}
+
+bool block_scanner_t::next( FILE * file, std::string & block )
+{
+	block.clear();
+	while( true ) {
+		const bmh_t & marker = m_inside ? m_close : m_begin;
+		const size_t avail = m_end - m_beg;
+		const size_t pos = marker.find( m_buf.data() + m_beg, avail );
+		if( pos < avail ) {
+			if( m_inside ) block.append( m_buf.data() + m_beg, pos );
+			m_beg += pos + marker.size();
+			m_inside = !m_inside;
+			if( !m_inside ) return true;
+			continue;
+		}
+		const size_t keep = std::min( avail, marker.size() - 1 );
+		if( m_inside ) block.append( m_buf.data() + m_beg, avail - keep );
+		m_beg = m_end - keep;
+		if( !fill( file ) ) {
+			// an unterminated block at the end of file is not a block
+			block.clear();
+			return false;
+		}
+	}
+}
+
+// initialize this in the init_fs function
+static int file_block_iterable_typeid;
+
+class var_file_block_iterable_t : public var_base_t
+{
+	var_file_t * m_file;
+	block_scanner_t m_scanner;
+	std::string m_block;
+public:
+	var_file_block_iterable_t( var_file_t * file, const block_scanner_t & scanner,
+				   const size_t & src_id, const size_t & idx );
+	~var_file_block_iterable_t();
+
+	var_base_t * copy( const size_t & src_id, const size_t & idx );
+	void set( var_base_t * from );
+
+	bool next( var_base_t * & val );
+};
+#define FILE_BLOCK_ITERABLE( x ) static_cast< var_file_block_iterable_t * >( x )
+
+var_file_block_iterable_t::var_file_block_iterable_t( var_file_t * file, const block_scanner_t & scanner,
+						      const size_t & src_id, const size_t & idx )
+	: var_base_t( file_block_iterable_typeid, src_id, idx ), m_file( file ), m_scanner( scanner )
+{
+	var_iref( m_file );
+}
+var_file_block_iterable_t::~var_file_block_iterable_t() { var_dref( m_file ); }
+
+var_base_t * var_file_block_iterable_t::copy( const size_t & src_id, const size_t & idx )
+{
+	return new var_file_block_iterable_t( m_file, m_scanner, src_id, idx );
+}
+void var_file_block_iterable_t::set( var_base_t * from )
+{
+	var_dref( m_file );
+	m_file = FILE_BLOCK_ITERABLE( from )->m_file;
+	var_iref( m_file );
+	m_scanner = FILE_BLOCK_ITERABLE( from )->m_scanner;
+}
+
+bool var_file_block_iterable_t::next( var_base_t * & val )
+{
+	if( !m_scanner.next( m_file->get(), m_block ) ) return false;
+	val = make< var_str_t >( m_block );
+	return true;
+}
+
+// compiled glob pattern supporting '*', '?', '[...]' (with '!' / '^' negation and ranges)
+// and '\\' escapes - a pattern without '/' is matched against the entry name, else
+// against the path relative to the walk root, where '*' and '?' do not match '/'
+// and a '**' component matches any number of directories
+class glob_matcher_t
+{
+	enum TokType {
+		GT_LIT,
+		GT_ANY,
+		GT_STAR,
+		GT_CLASS,
+	};
+	struct tok_t
+	{
+		TokType type;
+		char c;
+		size_t cls;
+	};
+	// path components of the pattern, a single one if it does not contain '/'
+	// an empty component stands for '**'
+	std::vector< std::vector< tok_t > > m_comps;
+	std::vector< std::vector< bool > > m_classes;
+	bool m_path_based;
+
+	bool comp_match( const std::vector< tok_t > & toks, const char * str, const size_t & len ) const;
+	bool path_match( const size_t & comp, const char * str, const size_t & len ) const;
+public:
+	glob_matcher_t( const std::string & pattern );
+
+	inline bool path_based() const { return m_path_based; }
+	bool match( const char * str, const size_t & len ) const;
+};
+
+glob_matcher_t::glob_matcher_t( const std::string & pattern )
+	: m_comps( 1 ), m_path_based( pattern.find( '/' ) != std::string::npos )
+{
+	for( size_t i = 0; i < pattern.size(); ++i ) {
+		const char c = pattern[ i ];
+		std::vector< tok_t > & toks = m_comps.back();
+		if( c == '/' ) {
+			m_comps.emplace_back();
+			continue;
+		}
+		if( c == '*' ) {
+			if( m_path_based && toks.empty() && i + 1 < pattern.size() && pattern[ i + 1 ] == '*' &&
+			    ( i + 2 == pattern.size() || pattern[ i + 2 ] == '/' ) ) {
+				// '**' component is left empty
+				++i;
+				continue;
+			}
+			if( toks.empty() || toks.back().type != GT_STAR ) toks.push_back( { GT_STAR, 0, 0 } );
+			continue;
+		}
+		if( c == '?' ) {
+			toks.push_back( { GT_ANY, 0, 0 } );
+			continue;
+		}
+		if( c == '[' ) {
+			size_t j = i + 1;
+			bool negate = j < pattern.size() && ( pattern[ j ] == '!' || pattern[ j ] == '^' );
+			if( negate ) ++j;
+			size_t end = pattern.find( ']', j + 1 );
+			if( end != std::string::npos ) {
+				std::vector< bool > cls( 256, false );
+				for( ; j < end; ++j ) {
+					unsigned char from = pattern[ j ];
+					unsigned char to = from;
+					if( j + 2 < end && pattern[ j + 1 ] == '-' ) {
+						to = pattern[ j + 2 ];
+						j += 2;
+					}
+					for( size_t ch = from; ch <= to; ++ch ) cls[ ch ] = true;
+				}
+				if( negate ) cls.flip();
+				m_classes.push_back( cls );
+				toks.push_back( { GT_CLASS, 0, m_classes.size() - 1 } );
+				i = end;
+				continue;
+			}
+		}
+		if( c == '\\' && i + 1 < pattern.size() ) {
+			toks.push_back( { GT_LIT, pattern[ ++i ], 0 } );
+			continue;
+		}
+		toks.push_back( { GT_LIT, c, 0 } );
+	}
+}
+
+// single component match, backtracking only to the last star seen
+bool glob_matcher_t::comp_match( const std::vector< tok_t > & toks, const char * str, const size_t & len ) const
+{
+	size_t ti = 0, si = 0, star = std::string::npos, mark = 0;
+	while( si < len ) {
+		if( ti < toks.size() ) {
+			const tok_t & tok = toks[ ti ];
+			if( tok.type == GT_STAR ) {
+				star = ti++;
+				mark = si;
+				continue;
+			}
+			if( ( tok.type == GT_LIT && tok.c == str[ si ] ) || tok.type == GT_ANY ||
+			    ( tok.type == GT_CLASS && m_classes[ tok.cls ][ ( unsigned char )str[ si ] ] ) ) {
+				++ti;
+				++si;
+				continue;
+			}
+		}
+		if( star == std::string::npos ) return false;
+		ti = star + 1;
+		si = ++mark;
+	}
+	while( ti < toks.size() && toks[ ti ].type == GT_STAR ) ++ti;
+	return ti == toks.size();
+}
+
+bool glob_matcher_t::path_match( const size_t & comp, const char * str, const size_t & len ) const
+{
+	if( comp == m_comps.size() ) return len == 0;
+	if( m_comps[ comp ].empty() ) {
+		// '**' - try it as zero or more leading directories
+		if( path_match( comp + 1, str, len ) ) return true;
+		const char * slash = ( const char * )memchr( str, '/', len );
+		while( slash != nullptr ) {
+			size_t off = slash - str + 1;
+			if( path_match( comp + 1, str + off, len - off ) ) return true;
+			slash = ( const char * )memchr( str + off, '/', len - off );
+		}
+		return false;
+	}
+	const char * slash = ( const char * )memchr( str, '/', len );
+	size_t clen = slash == nullptr ? len : slash - str;
+	if( !comp_match( m_comps[ comp ], str, clen ) ) return false;
+	if( slash == nullptr ) return comp + 1 == m_comps.size();
+	return path_match( comp + 1, slash + 1, len - clen - 1 );
+}
+
+bool glob_matcher_t::match( const char * str, const size_t & len ) const
+{
+	if( !m_path_based ) return comp_match( m_comps[ 0 ], str, len );
+	return path_match( 0, str, len );
+}
+
+// maximum number of directory descriptors kept open for queued directories,
+// the ones queued beyond that are opened by path when they are processed
+const int WALK_MAX_QUEUED_FDS = 256;
+// maximum number of paths waiting to be fetched by the iterator
+const size_t WALK_MAX_RESULTS = 8192;
+
+struct walk_job_t
+{
+	// with trailing '/', both
+	std::string path;
+	std::string rel;
+	int fd;
+	long depth;
+};
+
+// parallel directory walker - every worker owns a deque of directories, pops
+// from its back and steals from the front of the others' when it runs dry
+class walker_t
+{
+	struct queue_t
+	{
+		std::mutex mtx;
+		std::deque< walk_job_t > jobs;
+	};
+
+	glob_matcher_t m_glob;
+	size_t m_flags;
+	long m_max_depth;
+	bool m_follow;
+
+	std::vector< queue_t > m_queues;
+	std::vector< std::thread > m_workers;
+	// directories queued or being read
+	std::atomic< size_t > m_pending;
+	// directories in the queues
+	std::atomic< size_t > m_queued;
+	std::atomic< int > m_queued_fds;
+	std::atomic< bool > m_stop;
+	std::mutex m_work_mtx;
+	std::condition_variable m_work_cv;
+
+	std::mutex m_res_mtx;
+	std::condition_variable m_res_avail;
+	std::condition_variable m_res_space;
+	std::deque< std::string > m_results;
+	size_t m_running;
+
+	// directories already walked, to not loop on symlinks when they are followed
+	std::mutex m_seen_mtx;
+	std::set< std::pair< dev_t, ino_t > > m_seen;
+
+	void push_job( const size_t & id, walk_job_t & job );
+	bool pop_job( const size_t & id, walk_job_t & job );
+	void emit( std::string & path );
+	void read_dir( const size_t & id, walk_job_t & job );
+	void work( const size_t id );
+public:
+	walker_t( const std::string & root, const std::string & glob, const size_t & flags,
+		  const long & max_depth, const bool & follow, size_t threads );
+	~walker_t();
+
+	// blocks until the next path is available, false when the walk is complete
+	bool next( std::string & path );
+};
+
+walker_t::walker_t( const std::string & root, const std::string & glob, const size_t & flags,
+		    const long & max_depth, const bool & follow, size_t threads )
+	: m_glob( glob ), m_flags( flags ), m_max_depth( max_depth ), m_follow( follow ),
+	  m_queues( threads ), m_pending( 0 ), m_queued( 0 ), m_queued_fds( 0 ), m_stop( false ),
+	  m_running( threads )
+{
+	walk_job_t job{ root, "", -1, 0 };
+	if( m_follow ) {
+		struct stat st;
+		if( stat( root.empty() ? "." : root.c_str(), & st ) == 0 ) m_seen.insert( { st.st_dev, st.st_ino } );
+	}
+	push_job( 0, job );
+	for( size_t i = 0; i < threads; ++i ) m_workers.emplace_back( & walker_t::work, this, i );
+}
+
+walker_t::~walker_t()
+{
+	m_stop = true;
+	{
+		std::unique_lock< std::mutex > lock( m_work_mtx );
+		m_work_cv.notify_all();
+	}
+	{
+		std::unique_lock< std::mutex > lock( m_res_mtx );
+		m_res_space.notify_all();
+	}
+	for( auto & worker : m_workers ) worker.join();
+	for( auto & queue : m_queues ) {
+		for( auto & job : queue.jobs ) {
+			if( job.fd >= 0 ) close( job.fd );
+		}
+	}
+}
+
+void walker_t::push_job( const size_t & id, walk_job_t & job )
+{
+	++m_pending;
+	{
+		std::unique_lock< std::mutex > lock( m_queues[ id ].mtx );
+		m_queues[ id ].jobs.push_back( std::move( job ) );
+	}
+	++m_queued;
+	std::unique_lock< std::mutex > lock( m_work_mtx );
+	m_work_cv.notify_one();
+}
+
+bool walker_t::pop_job( const size_t & id, walk_job_t & job )
+{
+	for( size_t i = 0; i < m_queues.size(); ++i ) {
+		queue_t & queue = m_queues[ ( id + i ) % m_queues.size() ];
+		std::unique_lock< std::mutex > lock( queue.mtx );
+		if( queue.jobs.empty() ) continue;
+		// own queue is used as a stack (depth first), others are stolen from breadth first
+		if( i == 0 ) {
+			job = std::move( queue.jobs.back() );
+			queue.jobs.pop_back();
+		} else {
+			job = std::move( queue.jobs.front() );
+			queue.jobs.pop_front();
+		}
+		--m_queued;
+		return true;
+	}
+	return false;
+}
+
+void walker_t::emit( std::string & path )
+{
+	std::unique_lock< std::mutex > lock( m_res_mtx );
+	while( m_results.size() >= WALK_MAX_RESULTS && !m_stop ) m_res_space.wait( lock );
+	m_results.push_back( std::move( path ) );
+	m_res_avail.notify_one();
+}
+
+void walker_t::read_dir( const size_t & id, walk_job_t & job )
+{
+	int dfd = job.fd;
+	if( dfd >= 0 ) --m_queued_fds;
+	else dfd = open( job.path.empty() ? "." : job.path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+	if( dfd < 0 ) return;
+	DIR * dir = fdopendir( dfd );
+	if( dir == nullptr ) {
+		close( dfd );
+		return;
+	}
+	const bool descend = m_max_depth < 0 || job.depth < m_max_depth;
+	struct dirent * ent;
+	struct stat st;
+	while( !m_stop && ( ent = readdir( dir ) ) != nullptr ) {
+		const char * name = ent->d_name;
+		if( name[ 0 ] == '.' && ( name[ 1 ] == 0 || ( name[ 1 ] == '.' && name[ 2 ] == 0 ) ) ) continue;
+		unsigned char type = ent->d_type;
+		// only stat when the file system does not provide the type
+		if( type == DT_UNKNOWN && fstatat( dfd, name, & st, AT_SYMLINK_NOFOLLOW ) == 0 ) {
+			type = IFTODT( st.st_mode );
+		}
+		bool is_dir = type == DT_DIR;
+		if( type == DT_LNK && m_follow && fstatat( dfd, name, & st, 0 ) == 0 ) {
+			is_dir = S_ISDIR( st.st_mode );
+		}
+		const size_t name_len = strlen( name );
+		if( ( m_flags & ( is_dir ? WalkEntry::DIRS : WalkEntry::FILES ) ) ) {
+			bool matched;
+			if( m_glob.path_based() ) {
+				std::string rel = job.rel;
+				rel.append( name, name_len );
+				matched = m_glob.match( rel.data(), rel.size() );
+			} else {
+				matched = m_glob.match( name, name_len );
+			}
+			if( matched ) {
+				std::string path = job.path;
+				path.append( name, name_len );
+				emit( path );
+			}
+		}
+		if( !is_dir || !descend ) continue;
+		if( m_follow ) {
+			if( fstatat( dfd, name, & st, 0 ) != 0 ) continue;
+			std::unique_lock< std::mutex > lock( m_seen_mtx );
+			if( !m_seen.insert( { st.st_dev, st.st_ino } ).second ) continue;
+		}
+		walk_job_t child{ job.path, job.rel, -1, job.depth + 1 };
+		child.path.append( name, name_len ).push_back( '/' );
+		child.rel.append( name, name_len ).push_back( '/' );
+		if( m_queued_fds < WALK_MAX_QUEUED_FDS ) {
+			child.fd = openat( dfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC | ( m_follow ? 0 : O_NOFOLLOW ) );
+			if( child.fd >= 0 ) ++m_queued_fds;
+		}
+		push_job( id, child );
+	}
+	closedir( dir );
+}
+
+void walker_t::work( const size_t id )
+{
+	walk_job_t job;
+	while( !m_stop ) {
+		if( !pop_job( id, job ) ) {
+			std::unique_lock< std::mutex > lock( m_work_mtx );
+			while( m_queued == 0 && m_pending > 0 && !m_stop ) m_work_cv.wait( lock );
+			if( m_pending == 0 ) break;
+			continue;
+		}
+		read_dir( id, job );
+		if( --m_pending == 0 ) {
+			std::unique_lock< std::mutex > lock( m_work_mtx );
+			m_work_cv.notify_all();
+		}
+	}
+	std::unique_lock< std::mutex > lock( m_res_mtx );
+	--m_running;
+	m_res_avail.notify_all();
+}
+
+bool walker_t::next( std::string & path )
+{
+	std::unique_lock< std::mutex > lock( m_res_mtx );
+	while( m_results.empty() && m_running > 0 ) m_res_avail.wait( lock );
+	if( m_results.empty() ) return false;
+	path = std::move( m_results.front() );
+	m_results.pop_front();
+	m_res_space.notify_one();
+	return true;
+}
+
+// initialize this in the init_fs function
+static int walker_typeid;
+
+class var_walker_t : public var_base_t
+{
+	std::shared_ptr< walker_t > m_walker;
+public:
+	var_walker_t( const std::shared_ptr< walker_t > & walker, const size_t & src_id, const size_t & idx );
+
+	var_base_t * copy( const size_t & src_id, const size_t & idx );
+	void set( var_base_t * from );
+
+	bool next( var_base_t * & val );
+};
+#define WALKER( x ) static_cast< var_walker_t * >( x )
+
+var_walker_t::var_walker_t( const std::shared_ptr< walker_t > & walker, const size_t & src_id, const size_t & idx )
+	: var_base_t( walker_typeid, src_id, idx ), m_walker( walker ) {}
+
+var_base_t * var_walker_t::copy( const size_t & src_id, const size_t & idx )
+{
+	return new var_walker_t( m_walker, src_id, idx );
+}
+void var_walker_t::set( var_base_t * from )
+{
+	m_walker = WALKER( from )->m_walker;
+}
+
+bool var_walker_t::next( var_base_t * & val )
+{
+	std::string path;
+	if( !m_walker->next( path ) ) return false;
+	val = make< var_str_t >( path );
+	return true;
+}
+
+// read only mapping of an entire file, the line index is built on first use
+class mmap_buf_t
+{
+	const char * m_data;
+	size_t m_size;
+	// offset of the beginning of each line
+	std::vector< size_t > m_lines;
+	bool m_indexed;
+
+	void build_index();
+public:
+	mmap_buf_t( const char * data, const size_t & size );
+	~mmap_buf_t();
+
+	inline const char * data() const { return m_data; }
+	inline size_t size() const { return m_size; }
+
+	size_t line_count();
+	bool line( const size_t & i, const char * & beg, size_t & len );
+	// line beginning at offset off, returns the offset of the next one
+	size_t line_at( const size_t & off, const char * & beg, size_t & len ) const;
+};
+
+mmap_buf_t::mmap_buf_t( const char * data, const size_t & size )
+	: m_data( data ), m_size( size ), m_indexed( false ) {}
+mmap_buf_t::~mmap_buf_t()
+{
+	if( m_data ) munmap( ( void * )m_data, m_size );
+}
+
+// memchr is vectorized by the C library, so this runs at memory bandwidth
+void mmap_buf_t::build_index()
+{
+	m_indexed = true;
+	if( m_size == 0 ) return;
+	madvise( ( void * )m_data, m_size, MADV_SEQUENTIAL );
+	size_t off = 0;
+	while( off < m_size ) {
+		m_lines.push_back( off );
+		const char * nl = ( const char * )memchr( m_data + off, '\n', m_size - off );
+		if( nl == nullptr ) break;
+		off = nl - m_data + 1;
+	}
+	madvise( ( void * )m_data, m_size, MADV_NORMAL );
+}
+
+size_t mmap_buf_t::line_count()
+{
+	if( !m_indexed ) build_index();
+	return m_lines.size();
+}
+
+bool mmap_buf_t::line( const size_t & i, const char * & beg, size_t & len )
+{
+	if( i >= line_count() ) return false;
+	line_at( m_lines[ i ], beg, len );
+	return true;
+}
+
+size_t mmap_buf_t::line_at( const size_t & off, const char * & beg, size_t & len ) const
+{
+	beg = m_data + off;
+	const char * nl = ( const char * )memchr( beg, '\n', m_size - off );
+	size_t next = nl == nullptr ? m_size : nl - m_data + 1;
+	len = ( nl == nullptr ? m_data + m_size : nl ) - beg;
+	if( len > 0 && beg[ len - 1 ] == '\r' ) --len;
+	return next;
+}
+
+// initialize these in the init_fs function
+static int mmap_typeid;
+static int mmap_iterable_typeid;
+
+class var_mmap_t : public var_base_t
+{
+	std::shared_ptr< mmap_buf_t > m_buf;
+public:
+	var_mmap_t( const std::shared_ptr< mmap_buf_t > & buf, const size_t & src_id, const size_t & idx );
+
+	var_base_t * copy( const size_t & src_id, const size_t & idx );
+	void set( var_base_t * from );
+
+	inline std::shared_ptr< mmap_buf_t > & get() { return m_buf; }
+};
+#define MMAP( x ) static_cast< var_mmap_t * >( x )
+
+var_mmap_t::var_mmap_t( const std::shared_ptr< mmap_buf_t > & buf, const size_t & src_id, const size_t & idx )
+	: var_base_t( mmap_typeid, src_id, idx ), m_buf( buf ) {}
+
+var_base_t * var_mmap_t::copy( const size_t & src_id, const size_t & idx )
+{
+	return new var_mmap_t( m_buf, src_id, idx );
+}
+void var_mmap_t::set( var_base_t * from )
+{
+	m_buf = MMAP( from )->m_buf;
+}
+
+// iterates the lines of the mapping in sequence - requires no line index
+class var_mmap_iterable_t : public var_base_t
+{
+	std::shared_ptr< mmap_buf_t > m_buf;
+	size_t m_off;
+public:
+	var_mmap_iterable_t( const std::shared_ptr< mmap_buf_t > & buf, const size_t & src_id, const size_t & idx );
+
+	var_base_t * copy( const size_t & src_id, const size_t & idx );
+	void set( var_base_t * from );
+
+	bool next( var_base_t * & val );
+};
+#define MMAP_ITERABLE( x ) static_cast< var_mmap_iterable_t * >( x )
+
+var_mmap_iterable_t::var_mmap_iterable_t( const std::shared_ptr< mmap_buf_t > & buf, const size_t & src_id, const size_t & idx )
+	: var_base_t( mmap_iterable_typeid, src_id, idx ), m_buf( buf ), m_off( 0 ) {}
+
+var_base_t * var_mmap_iterable_t::copy( const size_t & src_id, const size_t & idx )
+{
+	var_mmap_iterable_t * it = new var_mmap_iterable_t( m_buf, src_id, idx );
+	it->m_off = m_off;
+	return it;
+}
+void var_mmap_iterable_t::set( var_base_t * from )
+{
+	m_buf = MMAP_ITERABLE( from )->m_buf;
+	m_off = MMAP_ITERABLE( from )->m_off;
+}
+
+bool var_mmap_iterable_t::next( var_base_t * & val )
+{
+	if( m_off >= m_buf->size() ) return false;
+	const char * beg;
+	size_t len;
+	m_off = m_buf->line_at( m_off, beg, len );
+	val = make< var_str_t >( std::string( beg, len ) );
+	return true;
+}
+
+// kinds of file system entries reported by stat
+enum StatType {
+	STAT_OTHER,
+	STAT_FILE,
+	STAT_DIR,
+	STAT_LINK,
+};
+
+// batches with fewer paths than this are stat'ed on the calling thread
+const size_t STAT_PARALLEL_MIN_PATHS = 64;
+// the stat cache is emptied when it grows beyond this many entries
+const size_t STAT_CACHE_MAX_ENTRIES = 1 << 20;
+
+// initialize this in the init_fs function
+static int stat_struct_id;
+
+struct stat_meta_t
+{
+	int err; // 0, else the errno of the failed stat
+	int type;
+	mode_t mode;
+	int64_t size;
+	int64_t mtime_ns;
+};
+
+// fetches the metadata of path - with statx, only the fields above are requested
+static void stat_fetch( const std::string & path, const bool & follow_links, stat_meta_t & meta )
+{
+	mode_t mode;
+	meta.err = 0;
+#if defined( __linux__ ) && defined( STATX_BASIC_STATS )
+	struct statx stx;
+	if( statx( AT_FDCWD, path.c_str(), follow_links ? 0 : AT_SYMLINK_NOFOLLOW,
+		   STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME, & stx ) == 0 ) {
+		mode = stx.stx_mode;
+		meta.size = stx.stx_size;
+		meta.mtime_ns = ( int64_t )stx.stx_mtime.tv_sec * 1000000000 + stx.stx_mtime.tv_nsec;
+	} else if( errno != ENOSYS ) {
+		meta.err = errno;
+		return;
+	} else
+#endif
+	{
+		struct stat st;
+		if( ( follow_links ? stat( path.c_str(), & st ) : lstat( path.c_str(), & st ) ) != 0 ) {
+			meta.err = errno;
+			return;
+		}
+		mode = st.st_mode;
+		meta.size = st.st_size;
+		meta.mtime_ns = mtime_ns( st );
+	}
+	meta.mode = mode & 07777;
+	meta.type = S_ISREG( mode ) ? STAT_FILE : S_ISDIR( mode ) ? STAT_DIR : S_ISLNK( mode ) ? STAT_LINK : STAT_OTHER;
+}
+
+// opt-in process wide metadata cache - entries, failures included, expire after the ttl
+// changes to the file system are only seen before that when the paths are invalidated
+// paths are cached as given, without any normalization
+class stat_cache_t
+{
+	std::mutex m_mtx;
+	// key is the follow links flag ('0' / '1') followed by the path
+	std::unordered_map< std::string, std::pair< stat_meta_t, int64_t > > m_entries;
+	std::atomic< int64_t > m_ttl_ns;
+
+	static int64_t now_ns();
+public:
+	stat_cache_t();
+
+	// a ttl of 0 disables the cache
+	void set_ttl( const int64_t & ttl_ns );
+	void invalidate( const std::string & path );
+	void clear();
+	bool enabled();
+
+	// looks the path up in the cache if it is enabled, fetching and caching it on a miss
+	void get( const std::string & path, const bool & follow_links, stat_meta_t & meta );
+};
+static stat_cache_t stat_cache;
+
+stat_cache_t::stat_cache_t() : m_ttl_ns( 0 ) {}
+
+int64_t stat_cache_t::now_ns()
+{
+	return std::chrono::duration_cast< std::chrono::nanoseconds >(
+		std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+void stat_cache_t::set_ttl( const int64_t & ttl_ns )
+{
+	m_ttl_ns = ttl_ns;
+	if( ttl_ns <= 0 ) clear();
+}
+
+void stat_cache_t::invalidate( const std::string & path )
+{
+	std::lock_guard< std::mutex > lock( m_mtx );
+	m_entries.erase( "0" + path );
+	m_entries.erase( "1" + path );
+}
+
+void stat_cache_t::clear()
+{
+	std::lock_guard< std::mutex > lock( m_mtx );
+	m_entries.clear();
+}
+
+bool stat_cache_t::enabled()
+{
+	return m_ttl_ns > 0;
+}
+
+void stat_cache_t::get( const std::string & path, const bool & follow_links, stat_meta_t & meta )
+{
+	const int64_t ttl = m_ttl_ns;
+	if( ttl <= 0 ) {
+		stat_fetch( path, follow_links, meta );
+		return;
+	}
+	const std::string key = ( follow_links ? "1" : "0" ) + path;
+	const int64_t now = now_ns();
+	{
+		std::lock_guard< std::mutex > lock( m_mtx );
+		auto it = m_entries.find( key );
+		if( it != m_entries.end() && now - it->second.second < ttl ) {
+			meta = it->second.first;
+			return;
+		}
+	}
+	stat_fetch( path, follow_links, meta );
+	std::lock_guard< std::mutex > lock( m_mtx );
+	if( m_entries.size() >= STAT_CACHE_MAX_ENTRIES ) m_entries.clear();
+	m_entries[ key ] = std::make_pair( meta, now );
+}
+
+// kinds of events reported by the watcher
+// WATCH_OVERFLOW (with an empty path) means events were lost and the tree should be rescanned
+enum WatchKind {
+	WATCH_CREATED,
+	WATCH_MODIFIED,
+	WATCH_DELETED,
+	WATCH_ATTRIB,
+	WATCH_OVERFLOW,
+};
+
+// interval of the polling fallback, used when inotify is not available
+const int WATCH_DEFAULT_POLL_MS = 1000;
+// a burst of events is collected for at most this many latency periods
+const int WATCH_MAX_COALESCE_PERIODS = 10;
+
+// initialize this in the init_fs function
+static int watch_event_struct_id;
+
+struct watch_event_t
+{
+	std::string path;
+	int kind;
+};
+
+// coalesces the events of a batch per path, keeping the order in which the paths were first seen
+class watch_batch_t
+{
+	std::vector< watch_event_t > m_events;
+	std::unordered_map< std::string, size_t > m_index;
+	size_t m_live;
+public:
+	watch_batch_t();
+
+	void add( const std::string & path, const int & kind );
+	bool empty();
+	std::vector< watch_event_t > take();
+};
+
+watch_batch_t::watch_batch_t() : m_live( 0 ) {}
+
+void watch_batch_t::add( const std::string & path, const int & kind )
+{
+	auto it = m_index.find( path );
+	if( it == m_index.end() ) {
+		m_index[ path ] = m_events.size();
+		m_events.push_back( { path, kind } );
+		++m_live;
+		return;
+	}
+	int & prev = m_events[ it->second ].kind;
+	if( prev < 0 ) {
+		prev = kind;
+		++m_live;
+	} else if( prev == WATCH_CREATED && kind == WATCH_DELETED ) {
+		// never existed as far as the batch is concerned
+		prev = -1;
+		--m_live;
+	} else if( prev == WATCH_DELETED && kind == WATCH_CREATED ) {
+		prev = WATCH_MODIFIED;
+	} else if( kind == WATCH_DELETED || ( kind == WATCH_MODIFIED && prev == WATCH_ATTRIB ) ) {
+		prev = kind;
+	}
+}
+
+bool watch_batch_t::empty() { return m_live == 0; }
+
+std::vector< watch_event_t > watch_batch_t::take()
+{
+	std::vector< watch_event_t > res;
+	res.reserve( m_live );
+	for( auto & e : m_events ) {
+		if( e.kind >= 0 ) res.push_back( std::move( e ) );
+	}
+	m_events.clear();
+	m_index.clear();
+	m_live = 0;
+	return res;
+}
+
+struct watch_snap_t
+{
+	int64_t mtime_ns;
+	int64_t size;
+	mode_t mode;
+};
+
+// watches files and directories (recursively, if requested) with inotify - or, where that is
+// not available, by comparing snapshots of the metadata every poll interval
+// a burst of events is coalesced into one batch, ending once no event comes for latency ms
+// watched paths which do not exist when the watcher is created are ignored
+class watcher_t
+{
+	std::vector< std::string > m_roots;
+	bool m_recursive;
+	int m_latency_ms;
+	int m_poll_ms;
+	int m_fd;
+	std::unordered_map< int, std::string > m_wds;
+	std::unordered_map< std::string, watch_snap_t > m_snap;
+	std::vector< char > m_buf;
+	watch_batch_t m_batch;
+
+	void start_polling( const int & poll_ms );
+	bool add_watch_tree( const std::string & path, const bool & report );
+	void read_inotify();
+	void snapshot_tree( const std::string & path, const bool & descend,
+			    std::unordered_map< std::string, watch_snap_t > & snap );
+	void diff_snapshot();
+
+	static int64_t now_ms();
+public:
+	watcher_t( const std::vector< std::string > & roots, const bool & recursive,
+		   const int & latency_ms, const int & poll_ms );
+	~watcher_t();
+
+	bool polling();
+	// waits up to timeout_ms (forever if negative) for a batch of events
+	// returns an empty vector on timeout
+	std::vector< watch_event_t > next_events( const int & timeout_ms );
+};
+
+watcher_t::watcher_t( const std::vector< std::string > & roots, const bool & recursive,
+		      const int & latency_ms, const int & poll_ms )
+	: m_roots( roots ), m_recursive( recursive ), m_latency_ms( latency_ms ), m_poll_ms( 0 ), m_fd( -1 )
+{
+	for( auto & root : m_roots ) {
+		while( root.size() > 1 && root.back() == '/' ) root.pop_back();
+	}
+#if __linux__
+	if( poll_ms <= 0 ) m_fd = inotify_init1( IN_NONBLOCK | IN_CLOEXEC );
+#endif
+	if( m_fd < 0 ) {
+		start_polling( poll_ms > 0 ? poll_ms : WATCH_DEFAULT_POLL_MS );
+		return;
+	}
+	m_buf.resize( 64 * 1024 );
+	for( auto & root : m_roots ) {
+		if( !add_watch_tree( root, false ) ) return;
+	}
+}
+
+watcher_t::~watcher_t()
+{
+	if( m_fd >= 0 ) close( m_fd );
+}
+
+void watcher_t::start_polling( const int & poll_ms )
+{
+	if( m_fd >= 0 ) close( m_fd );
+	m_fd = -1;
+	m_wds.clear();
+	m_poll_ms = poll_ms;
+	m_snap.clear();
+	for( auto & root : m_roots ) snapshot_tree( root, true, m_snap );
+}
+
+// returns false if the watcher had to fall back to polling (out of inotify watches)
+bool watcher_t::add_watch_tree( const std::string & path, const bool & report )
+{
+#if __linux__
+	const uint32_t mask = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+			      IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_DONT_FOLLOW;
+	int wd = inotify_add_watch( m_fd, path.c_str(), mask );
+	if( wd < 0 ) {
+		if( errno != ENOSPC ) return true;
+		start_polling( WATCH_DEFAULT_POLL_MS );
+		return false;
+	}
+	m_wds[ wd ] = path;
+	if( !m_recursive ) return true;
+	DIR * dir = opendir( path.c_str() );
+	if( dir == nullptr ) return true;
+	struct dirent * ent;
+	while( ( ent = readdir( dir ) ) != nullptr ) {
+		if( strcmp( ent->d_name, "." ) == 0 || strcmp( ent->d_name, ".." ) == 0 ) continue;
+		const std::string entry = path + "/" + ent->d_name;
+		// entries of a new directory may have been created before it was watched
+		if( report ) m_batch.add( entry, WATCH_CREATED );
+		unsigned char type = ent->d_type;
+		struct stat st;
+		if( type == DT_UNKNOWN && lstat( entry.c_str(), & st ) == 0 ) type = IFTODT( st.st_mode );
+		if( type == DT_DIR && !add_watch_tree( entry, report ) ) {
+			closedir( dir );
+			return false;
+		}
+	}
+	closedir( dir );
+#endif
+	return true;
+}
+
+void watcher_t::read_inotify()
+{
+#if __linux__
+	while( true ) {
+		ssize_t len = read( m_fd, m_buf.data(), m_buf.size() );
+		if( len < 0 && errno == EINTR ) continue;
+		if( len <= 0 ) return;
+		for( ssize_t off = 0; off < len; ) {
+			const struct inotify_event * ev = ( const struct inotify_event * )( m_buf.data() + off );
+			off += sizeof( struct inotify_event ) + ev->len;
+			if( ev->mask & IN_Q_OVERFLOW ) {
+				m_batch.add( "", WATCH_OVERFLOW );
+				continue;
+			}
+			auto it = m_wds.find( ev->wd );
+			if( it == m_wds.end() ) continue;
+			if( ev->mask & IN_IGNORED ) {
+				m_wds.erase( it );
+				continue;
+			}
+			std::string path = it->second;
+			if( ev->len > 0 ) path += std::string( "/" ) + ev->name;
+			if( ev->mask & ( IN_CREATE | IN_MOVED_TO ) ) {
+				m_batch.add( path, WATCH_CREATED );
+				if( m_recursive && ( ev->mask & IN_ISDIR ) && !add_watch_tree( path, true ) ) return;
+			} else if( ev->mask & ( IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF ) ) {
+				// children report their own deletion, the directory itself is reported once
+				if( ( ev->mask & ( IN_DELETE_SELF | IN_MOVE_SELF ) ) &&
+				    std::find( m_roots.begin(), m_roots.end(), path ) == m_roots.end() ) continue;
+				m_batch.add( path, WATCH_DELETED );
+			} else if( ev->mask & ( IN_MODIFY | IN_CLOSE_WRITE ) ) {
+				m_batch.add( path, WATCH_MODIFIED );
+			} else if( ev->mask & IN_ATTRIB ) {
+				m_batch.add( path, WATCH_ATTRIB );
+			}
+		}
+	}
+#endif
+}
+
+void watcher_t::snapshot_tree( const std::string & path, const bool & descend,
+			       std::unordered_map< std::string, watch_snap_t > & snap )
+{
+	struct stat st;
+	if( lstat( path.c_str(), & st ) != 0 ) return;
+	snap[ path ] = { mtime_ns( st ), st.st_size, st.st_mode };
+	if( !descend || !S_ISDIR( st.st_mode ) ) return;
+	DIR * dir = opendir( path.c_str() );
+	if( dir == nullptr ) return;
+	struct dirent * ent;
+	while( ( ent = readdir( dir ) ) != nullptr ) {
+		if( strcmp( ent->d_name, "." ) == 0 || strcmp( ent->d_name, ".." ) == 0 ) continue;
+		// like inotify, a non recursive watch on a directory covers its entries
+		snapshot_tree( path + "/" + ent->d_name, m_recursive, snap );
+	}
+	closedir( dir );
+}
+
+void watcher_t::diff_snapshot()
+{
+	std::unordered_map< std::string, watch_snap_t > snap;
+	for( auto & root : m_roots ) snapshot_tree( root, true, snap );
+	for( auto & e : snap ) {
+		auto it = m_snap.find( e.first );
+		if( it == m_snap.end() ) {
+			m_batch.add( e.first, WATCH_CREATED );
+			continue;
+		}
+		const watch_snap_t & prev = it->second;
+		// changes to the entries of a directory are reported on the entries
+		if( !S_ISDIR( e.second.mode ) && ( prev.mtime_ns != e.second.mtime_ns || prev.size != e.second.size ) ) {
+			m_batch.add( e.first, WATCH_MODIFIED );
+		} else if( prev.mode != e.second.mode ) {
+			m_batch.add( e.first, WATCH_ATTRIB );
+		}
+	}
+	for( auto & e : m_snap ) {
+		if( snap.find( e.first ) == snap.end() ) m_batch.add( e.first, WATCH_DELETED );
+	}
+	m_snap.swap( snap );
+}
+
+int64_t watcher_t::now_ms()
+{
+	return std::chrono::duration_cast< std::chrono::milliseconds >(
+		std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+bool watcher_t::polling() { return m_fd < 0; }
+
+std::vector< watch_event_t > watcher_t::next_events( const int & timeout_ms )
+{
+	const int64_t deadline = now_ms() + timeout_ms;
+	struct pollfd pfd = { m_fd, POLLIN, 0 };
+	while( m_batch.empty() ) {
+		if( m_fd < 0 ) {
+			diff_snapshot();
+			if( !m_batch.empty() ) return m_batch.take();
+			int64_t wait = m_poll_ms;
+			if( timeout_ms >= 0 ) {
+				wait = std::min( wait, deadline - now_ms() );
+				if( wait <= 0 ) return m_batch.take();
+			}
+			std::this_thread::sleep_for( std::chrono::milliseconds( wait ) );
+			continue;
+		}
+		int wait = -1;
+		if( timeout_ms >= 0 ) {
+			wait = std::max( deadline - now_ms(), ( int64_t )0 );
+		}
+		int res = poll( & pfd, 1, wait );
+		if( res < 0 && errno == EINTR ) continue;
+		if( res <= 0 ) return m_batch.take();
+		// may run out of watches and switch to polling, which the loop picks up
+		read_inotify();
+	}
+	// collect the rest of the burst
+	const int64_t coalesce_end = now_ms() + m_latency_ms * WATCH_MAX_COALESCE_PERIODS;
+	while( m_fd >= 0 && m_latency_ms > 0 && now_ms() < coalesce_end ) {
+		int res = poll( & pfd, 1, m_latency_ms );
+		if( res < 0 && errno == EINTR ) continue;
+		if( res <= 0 ) break;
+		read_inotify();
+	}
+	return m_batch.take();
+}
+
+// initialize this in the init_fs function
+static int watcher_typeid;
+
+class var_watcher_t : public var_base_t
+{
+	std::shared_ptr< watcher_t > m_watcher;
+public:
+	var_watcher_t( const std::shared_ptr< watcher_t > & watcher, const size_t & src_id, const size_t & idx );
+
+	var_base_t * copy( const size_t & src_id, const size_t & idx );
+	void set( var_base_t * from );
+
+	std::shared_ptr< watcher_t > & get();
+};
+#define WATCHER( x ) static_cast< var_watcher_t * >( x )
+
+var_watcher_t::var_watcher_t( const std::shared_ptr< watcher_t > & watcher, const size_t & src_id, const size_t & idx )
+	: var_base_t( watcher_typeid, src_id, idx ), m_watcher( watcher ) {}
+
+var_base_t * var_watcher_t::copy( const size_t & src_id, const size_t & idx )
+{
+	return new var_watcher_t( m_watcher, src_id, idx );
+}
+void var_watcher_t::set( var_base_t * from )
+{
+	m_watcher = WATCHER( from )->m_watcher;
+}
+
+std::shared_ptr< watcher_t > & var_watcher_t::get() { return m_watcher; }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////// Functions /////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+var_base_t * fs_exists( vm_state_t & vm, const fn_data_t & fd )
+{
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for path, found: %s",
+						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	const std::string & path = STR( fd.args[ 1 ] )->get();
+	// without the stat cache, access() is the cheapest check
+	if( !stat_cache.enabled() ) return access( path.c_str(), F_OK ) != -1 ? vm.tru : vm.fals;
+	stat_meta_t meta;
+	stat_cache.get( path, true, meta );
+	return meta.err == 0 ? vm.tru : vm.fals;
+}
+
+// attributes of the stat_t struct for the (successfully fetched) metadata
+static std::unordered_map< std::string, var_base_t * > stat_attrs( const stat_meta_t & meta, const size_t & src_id,
+								    const size_t & idx )
+{
+	std::unordered_map< std::string, var_base_t * > attrs;
+	attrs[ "size" ] = new var_int_t( ( long )meta.size, src_id, idx );
+	attrs[ "mtime" ] = new var_int_t( ( long )meta.mtime_ns, src_id, idx );
+	attrs[ "mode" ] = new var_int_t( ( long )meta.mode, src_id, idx );
+	attrs[ "type" ] = new var_int_t( meta.type, src_id, idx );
+	return attrs;
+}
+
+var_base_t * fs_stat( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		src->fail( fd.idx, "expected string argument for path, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 2 ]->type() != VT_BOOL ) {
+		src->fail( fd.idx, "expected boolean argument for follow_links, found: %s",
+			   vm.type_name( fd.args[ 2 ]->type() ).c_str() );
+		return nullptr;
+	}
+	stat_meta_t meta;
+	stat_cache.get( STR( fd.args[ 1 ] )->get(), BOOL( fd.args[ 2 ] )->get(), meta );
+	if( meta.err != 0 ) return vm.nil;
+	return make< var_struct_t >( stat_struct_id, stat_attrs( meta, fd.src_id, fd.idx ) );
+}
+
+// stats all the paths in the vector (in parallel for large ones)
+// returns a vector of stat_t in the same order, with nil for the paths which failed
+var_base_t * fs_stat_many( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_VEC ) {
+		src->fail( fd.idx, "expected vector argument for paths, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 2 ]->type() != VT_BOOL ) {
+		src->fail( fd.idx, "expected boolean argument for follow_links, found: %s",
+			   vm.type_name( fd.args[ 2 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 3 ]->type() != VT_INT ) {
+		src->fail( fd.idx, "expected int argument for threads, found: %s",
+			   vm.type_name( fd.args[ 3 ]->type() ).c_str() );
+		return nullptr;
+	}
+	const std::vector< var_base_t * > & vec = VEC( fd.args[ 1 ] )->get();
+	std::vector< const std::string * > paths;
+	paths.reserve( vec.size() );
+	for( auto & e : vec ) {
+		if( e->type() != VT_STR ) {
+			src->fail( fd.idx, "expected vector of strings for paths, found element: %s",
+				   vm.type_name( e->type() ).c_str() );
+			return nullptr;
+		}
+		paths.push_back( & STR( e )->get() );
+	}
+	const bool follow_links = BOOL( fd.args[ 2 ] )->get();
+	long threads = INT( fd.args[ 3 ] )->get().get_si();
+	if( threads <= 0 ) threads = std::max( std::thread::hardware_concurrency(), 1U );
+	if( paths.size() < STAT_PARALLEL_MIN_PATHS ) threads = 1;
+	threads = std::min( ( size_t )threads, paths.size() / STAT_PARALLEL_MIN_PATHS + 1 );
+
+	std::vector< stat_meta_t > metas( paths.size() );
+	std::atomic< size_t > next( 0 );
+	auto worker = [ & ]() {
+		for( size_t i = next++; i < paths.size(); i = next++ ) {
+			stat_cache.get( * paths[ i ], follow_links, metas[ i ] );
+		}
+	};
+	std::vector< std::thread > pool;
+	for( long i = 1; i < threads; ++i ) pool.emplace_back( worker );
+	worker();
+	for( auto & t : pool ) t.join();
+
+	std::vector< var_base_t * > res;
+	res.reserve( metas.size() );
+	for( auto & meta : metas ) {
+		if( meta.err != 0 ) {
+			var_iref( vm.nil );
+			res.push_back( vm.nil );
+			continue;
+		}
+		res.push_back( new var_struct_t( stat_struct_id, stat_attrs( meta, fd.src_id, fd.idx ), fd.src_id, fd.idx ) );
+	}
+	return make< var_vec_t >( res );
+}
+
+// enables the stat cache with the given ttl in milliseconds, 0 disables (and empties) it
+var_base_t * fs_stat_cache( vm_state_t & vm, const fn_data_t & fd )
+{
+	if( fd.args[ 1 ]->type() != VT_INT ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected int argument for ttl, found: %s",
+						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	stat_cache.set_ttl( ( int64_t )INT( fd.args[ 1 ] )->get().get_si() * 1000000 );
+	return vm.nil;
+}
+
+// drops the given paths from the stat cache, or all of them if none are given
+var_base_t * fs_stat_invalidate( vm_state_t & vm, const fn_data_t & fd )
+{
+	for( size_t i = 1; i < fd.args.size(); ++i ) {
+		if( fd.args[ i ]->type() != VT_STR ) {
+			vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for path, found: %s",
+							  vm.type_name( fd.args[ i ]->type() ).c_str() );
+			return nullptr;
+		}
+	}
+	if( fd.args.size() == 1 ) stat_cache.clear();
+	for( size_t i = 1; i < fd.args.size(); ++i ) stat_cache.invalidate( STR( fd.args[ i ] )->get() );
+	return vm.nil;
+}
+
+// paths is a string or a vector of strings
+var_base_t * fs_watch( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	std::vector< std::string > paths;
+	if( fd.args[ 1 ]->type() == VT_STR ) {
+		paths.push_back( STR( fd.args[ 1 ] )->get() );
+	} else if( fd.args[ 1 ]->type() == VT_VEC ) {
+		for( auto & e : VEC( fd.args[ 1 ] )->get() ) {
+			if( e->type() != VT_STR ) {
+				src->fail( fd.idx, "expected vector of strings for paths, found element: %s",
+					   vm.type_name( e->type() ).c_str() );
+				return nullptr;
+			}
+			paths.push_back( STR( e )->get() );
+		}
+	} else {
+		src->fail( fd.idx, "expected string or vector argument for paths, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 2 ]->type() != VT_BOOL ) {
+		src->fail( fd.idx, "expected boolean argument for recursive, found: %s",
+			   vm.type_name( fd.args[ 2 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 3 ]->type() != VT_INT ) {
+		src->fail( fd.idx, "expected int argument for latency, found: %s",
+			   vm.type_name( fd.args[ 3 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 4 ]->type() != VT_INT ) {
+		src->fail( fd.idx, "expected int argument for poll interval, found: %s",
+			   vm.type_name( fd.args[ 4 ]->type() ).c_str() );
+		return nullptr;
+	}
+	std::shared_ptr< watcher_t > watcher( new watcher_t( paths, BOOL( fd.args[ 2 ] )->get(),
+							     INT( fd.args[ 3 ] )->get().get_si(),
+							     INT( fd.args[ 4 ] )->get().get_si() ) );
+	return make< var_watcher_t >( watcher );
+}
+
+// returns a vector of watch_event_t (path, kind) structs, empty on timeout
+var_base_t * fs_watcher_next_events( vm_state_t & vm, const fn_data_t & fd )
+{
+	if( fd.args[ 1 ]->type() != VT_INT ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected int argument for timeout, found: %s",
+						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	std::vector< watch_event_t > events = WATCHER( fd.args[ 0 ] )->get()->next_events( INT( fd.args[ 1 ] )->get().get_si() );
+	std::vector< var_base_t * > res;
+	res.reserve( events.size() );
+	for( auto & e : events ) {
+		std::unordered_map< std::string, var_base_t * > attrs;
+		attrs[ "path" ] = new var_str_t( e.path, fd.src_id, fd.idx );
+		attrs[ "kind" ] = new var_int_t( e.kind, fd.src_id, fd.idx );
+		res.push_back( new var_struct_t( watch_event_struct_id, attrs, fd.src_id, fd.idx ) );
+	}
+	return make< var_vec_t >( res );
+}
+
+var_base_t * fs_watcher_polling( vm_state_t & vm, const fn_data_t & fd )
 {
-	var_iref( m_file );
+	return WATCHER( fd.args[ 0 ] )->get()->polling() ? vm.tru : vm.fals;
 }
-var_file_iterable_t::~var_file_iterable_t() { var_dref( m_file ); }
 
-var_base_t * var_file_iterable_t::copy( const size_t & src_id, const size_t & idx )
+// writes all of data to the descriptor, returns 0 on success, else the errno
+static int write_full( const int & fdesc, const std::string & data )
 {
-	return new var_file_iterable_t( m_file, src_id, idx );
+	for( size_t off = 0; off < data.size(); ) {
+		ssize_t res = write( fdesc, data.data() + off, data.size() - off );
+		if( res < 0 && errno == EINTR ) continue;
+		if( res < 0 ) return errno;
+		off += res;
+	}
+	return 0;
 }
-void var_file_iterable_t::set( var_base_t * from )
+
+// creates a new file at base + a unique suffix with the mode, less the umask (as open() does) -
+// unlike with mkstemp(), whose files are always 0600
+// returns the descriptor (-1 with errno set on failure), the path of the file is in path
+static int create_unique( const std::string & base, const mode_t & mode, std::string & path )
 {
-	var_dref( m_file );
-	m_file = FILE_ITERABLE( from )->m_file;
-	var_iref( m_file );
+	static std::atomic< unsigned > counter( 0 );
+	const unsigned long stamp = std::chrono::steady_clock::now().time_since_epoch().count();
+	for( int attempt = 0; attempt < 64; ++attempt ) {
+		char suffix[ 64 ];
+		snprintf( suffix, sizeof( suffix ), ".%ld.%lx.%u", ( long )getpid(), stamp, counter++ );
+		path = base + suffix;
+		int fdesc = open( path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, mode );
+		if( fdesc >= 0 || errno != EEXIST ) return fdesc;
+	}
+	return -1;
 }
 
-bool var_file_iterable_t::next( var_base_t * & val )
+// reads the whole file in one string, sized up front from fstat
+var_base_t * fs_read_all( vm_state_t & vm, const fn_data_t & fd )
 {
-	char * line_ptr = NULL;
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		src->fail( fd.idx, "expected string argument for file name, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	const std::string & file_name = STR( fd.args[ 1 ] )->get();
+	int fdesc = open( file_name.c_str(), O_RDONLY | O_CLOEXEC );
+	if( fdesc < 0 ) {
+		src->fail( fd.idx, "failed to open file '%s': %s", file_name.c_str(), strerror( errno ) );
+		return nullptr;
+	}
+	struct stat st;
+	if( fstat( fdesc, & st ) < 0 ) {
+		src->fail( fd.idx, "failed to stat file '%s': %s", file_name.c_str(), strerror( errno ) );
+		close( fdesc );
+		return nullptr;
+	}
+#if defined( POSIX_FADV_SEQUENTIAL )
+	posix_fadvise( fdesc, 0, 0, POSIX_FADV_SEQUENTIAL );
+#endif
+	std::string data;
+	// files such as the ones in /proc report a size of 0, those (and files which
+	// grew since the fstat) are read in blocks until the end
+	data.resize( st.st_size > 0 ? st.st_size + 1 : 64 * 1024 );
 	size_t len = 0;
-	ssize_t read = 0;
-
-	if( ( read = getline( & line_ptr, & len, m_file->get() ) ) != -1 ) {
-		std::string line = line_ptr;
-		free( line_ptr );
-		while( line.back() == '\n' ) line.pop_back();
-		while( line.back() == '\r' ) line.pop_back();
-		val = make< var_str_t >( line );
-		return true;
+	while( true ) {
+		if( len == data.size() ) data.resize( data.size() * 2 );
+		ssize_t rd = read( fdesc, & data[ len ], data.size() - len );
+		if( rd < 0 && errno == EINTR ) continue;
+		if( rd < 0 ) {
+			src->fail( fd.idx, "failed to read file '%s': %s", file_name.c_str(), strerror( errno ) );
+			close( fdesc );
+			return nullptr;
+		}
+		if( rd == 0 ) break;
+		len += rd;
 	}
-	if( line_ptr ) free( line_ptr );
-	return false;
+	close( fdesc );
+	data.resize( len );
+	var_str_t * res = make< var_str_t >( "" );
+	res->get().swap( data );
+	return res;
 }
 
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
-//////////////////////////////////////////////////////////// Functions /////////////////////////////////////////////////////////////////
-////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+// writes data to the file, creating or truncating it
+var_base_t * fs_write_all( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		src->fail( fd.idx, "expected string argument for file name, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 2 ]->type() != VT_STR ) {
+		src->fail( fd.idx, "expected string argument for data, found: %s",
+			   vm.type_name( fd.args[ 2 ]->type() ).c_str() );
+		return nullptr;
+	}
+	const std::string & file_name = STR( fd.args[ 1 ] )->get();
+	int fdesc = open( file_name.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666 );
+	if( fdesc < 0 ) {
+		src->fail( fd.idx, "failed to open file '%s': %s", file_name.c_str(), strerror( errno ) );
+		return nullptr;
+	}
+	int err = write_full( fdesc, STR( fd.args[ 2 ] )->get() );
+	if( close( fdesc ) != 0 && err == 0 ) err = errno;
+	if( err != 0 ) {
+		src->fail( fd.idx, "failed to write file '%s': %s", file_name.c_str(), strerror( err ) );
+		return nullptr;
+	}
+	stat_cache.invalidate( file_name );
+	return vm.nil;
+}
 
-var_base_t * fs_exists( vm_state_t & vm, const fn_data_t & fd )
+// replaces the file with data such that readers see either the old or the new contents,
+// even across a crash: the data is written to a temporary file in the same directory,
+// synced, and renamed over the file - the directory is synced to persist the rename
+// the file keeps its permissions if it exists
+var_base_t * fs_replace_atomic( vm_state_t & vm, const fn_data_t & fd )
 {
+	srcfile_t * src = vm.src_stack.back()->src();
 	if( fd.args[ 1 ]->type() != VT_STR ) {
-		vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for path, found: %s",
-						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		src->fail( fd.idx, "expected string argument for file name, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 2 ]->type() != VT_STR ) {
+		src->fail( fd.idx, "expected string argument for data, found: %s",
+			   vm.type_name( fd.args[ 2 ]->type() ).c_str() );
 		return nullptr;
 	}
-	return access( STR( fd.args[ 1 ] )->get().c_str(), F_OK ) != -1 ? vm.tru : vm.fals;
+	const std::string & file_name = STR( fd.args[ 1 ] )->get();
+	const size_t slash = file_name.find_last_of( '/' );
+	const std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : file_name.substr( 0, slash );
+	const std::string tmp_base = ( slash == std::string::npos ? "" : file_name.substr( 0, slash + 1 ) ) + "." +
+				     file_name.substr( slash == std::string::npos ? 0 : slash + 1 );
+
+	// a new file gets 0666 less the umask from the kernel, an existing one keeps its mode
+	struct stat st;
+	const bool exists = stat( file_name.c_str(), & st ) == 0;
+	std::string tmp;
+	int fdesc = create_unique( tmp_base, 0666, tmp );
+	if( fdesc < 0 ) {
+		src->fail( fd.idx, "failed to create temporary file for '%s': %s", file_name.c_str(), strerror( errno ) );
+		return nullptr;
+	}
+	int err = write_full( fdesc, STR( fd.args[ 2 ] )->get() );
+	if( err == 0 && exists && fchmod( fdesc, st.st_mode & 07777 ) != 0 ) err = errno;
+	if( err == 0 && fsync( fdesc ) != 0 ) err = errno;
+	if( close( fdesc ) != 0 && err == 0 ) err = errno;
+	if( err == 0 && rename( tmp.c_str(), file_name.c_str() ) != 0 ) err = errno;
+	if( err != 0 ) {
+		unlink( tmp.c_str() );
+		src->fail( fd.idx, "failed to replace file '%s': %s", file_name.c_str(), strerror( err ) );
+		return nullptr;
+	}
+	stat_cache.invalidate( file_name );
+	int dirfd = open( dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+	if( dirfd >= 0 ) {
+		fsync( dirfd );
+		close( dirfd );
+	}
+	return vm.nil;
 }
 
 var_base_t * fs_open( vm_state_t & vm, const fn_data_t & fd )
@@ -129,10 +1750,9 @@ var_base_t * fs_file_lines( vm_state_t & vm, const fn_data_t & fd )
 
 	std::vector< var_base_t * > lines;
 	while( ( read = getline( & line_ptr, & len, file ) ) != -1 ) {
-		std::string line = line_ptr;
-		while( line.back() == '\n' ) line.pop_back();
-		while( line.back() == '\r' ) line.pop_back();
-		lines.push_back( new var_str_t( line, fd.src_id, fd.idx ) );
+		while( read > 0 && line_ptr[ read - 1 ] == '\n' ) --read;
+		while( read > 0 && line_ptr[ read - 1 ] == '\r' ) --read;
+		lines.push_back( new var_str_t( std::string( line_ptr, read ), fd.src_id, fd.idx ) );
 	}
 	if( line_ptr ) free( line_ptr );
 	fseek( file, 0, SEEK_SET );
@@ -161,72 +1781,224 @@ var_base_t * fs_file_seek( vm_state_t & vm, const fn_data_t & fd )
 
 var_base_t * fs_file_each_line( vm_state_t & vm, const fn_data_t & fd )
 {
-	return make< var_file_iterable_t >( FILE( fd.args[ 0 ] ) );
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_INT ) {
+		src->fail( fd.idx, "expected int argument for read buffer size, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 2 ]->type() != VT_STR ) {
+		src->fail( fd.idx, "expected string argument for record delimiter, found: %s",
+			   vm.type_name( fd.args[ 2 ]->type() ).c_str() );
+		return nullptr;
+	}
+	const std::string & delim = STR( fd.args[ 2 ] )->get();
+	if( delim.empty() ) {
+		src->fail( fd.idx, "found empty delimiter for file each_line" );
+		return nullptr;
+	}
+	size_t buf_size = INT( fd.args[ 1 ] )->get().get_ui();
+	if( buf_size == 0 ) buf_size = FILE_ITERABLE_BUF_SIZE;
+	return make< var_file_iterable_t >( FILE( fd.args[ 0 ] ), buf_size, delim );
 }
 
-var_base_t * fs_file_read_blocks( vm_state_t & vm, const fn_data_t & fd )
+// validates the begin and end block markers (args 1 and 2)
+static bool block_markers_valid( vm_state_t & vm, const fn_data_t & fd )
 {
 	srcfile_t * src = vm.src_stack.back()->src();
-	FILE * const file = FILE( fd.args[ 0 ] )->get();
-
 	if( fd.args[ 1 ]->type() != VT_STR ) {
 		src->fail( fd.idx, "expected string argument for block begin location, found: %s",
 			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
-		return nullptr;
+		return false;
 	}
 	if( fd.args[ 2 ]->type() != VT_STR ) {
 		src->fail( fd.idx, "expected string argument for block end location, found: %s",
 			   vm.type_name( fd.args[ 2 ]->type() ).c_str() );
-		return nullptr;
+		return false;
 	}
+	if( STR( fd.args[ 1 ] )->get().empty() || STR( fd.args[ 2 ] )->get().empty() ) {
+		src->fail( fd.idx, "block begin and end locations cannot be empty" );
+		return false;
+	}
+	return true;
+}
 
-	const std::string & begin = STR( fd.args[ 1 ] )->get();
-	const std::string & end = STR( fd.args[ 2 ] )->get();
-	bool inside_block = false;
-
-	char * line_ptr = NULL;
-	size_t len = 0;
-	ssize_t read = 0;
+var_base_t * fs_file_read_blocks( vm_state_t & vm, const fn_data_t & fd )
+{
+	FILE * const file = FILE( fd.args[ 0 ] )->get();
+	if( !block_markers_valid( vm, fd ) ) return nullptr;
 
-	std::string line;
+	block_scanner_t scanner( STR( fd.args[ 1 ] )->get(), STR( fd.args[ 2 ] )->get(),
+				 BLOCK_SCAN_WINDOW_SIZE );
 	std::string block_content;
 	std::vector< var_base_t * > blocks;
-	while( ( read = getline( & line_ptr, & len, file ) ) != -1 ) {
-		line = line_ptr;
-	begin_fetch:
-		if( line.empty() ) continue;
-		if( !inside_block ) {
-			size_t pos = line.find( begin );
-			if( pos == std::string::npos ) continue;
-			inside_block = true;
-			if( pos + begin.size() > line.size() ) continue;
-			else line = line.substr( pos + begin.size() );
-			goto begin_fetch;
-		}
-		size_t pos = line.find( end );
-		if( pos == std::string::npos ) { block_content += line; continue; }
-		block_content += line.substr( 0, pos );
-		if( pos + end.size() <= line.size() ) line = line.substr( pos + end.size() );
-		else line.clear();
-		inside_block = false;
+	while( scanner.next( file, block_content ) ) {
 		blocks.push_back( new var_str_t( block_content, fd.src_id, fd.idx ) );
-		block_content.clear();
-		goto begin_fetch;
 	}
-
-	if( line_ptr ) free( line_ptr );
 	fseek( file, 0, SEEK_SET );
 
-	// this should actually never occur since block_content
-	// is always pushed back when end point is found
-	// if( !block_content.empty() ) {
-	// 	blocks.push_back( new var_str_t( block_content, fd.src_id, fd.idx ) );
-	// }
-	assert( block_content.empty() );
-
 	return make< var_vec_t >( blocks );
 }
 
+var_base_t * fs_file_each_block( vm_state_t & vm, const fn_data_t & fd )
+{
+	if( !block_markers_valid( vm, fd ) ) return nullptr;
+	if( fd.args[ 3 ]->type() != VT_INT ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected int argument for scan window size, found: %s",
+						  vm.type_name( fd.args[ 3 ]->type() ).c_str() );
+		return nullptr;
+	}
+	size_t window = INT( fd.args[ 3 ] )->get().get_ui();
+	if( window == 0 ) window = BLOCK_SCAN_WINDOW_SIZE;
+	block_scanner_t scanner( STR( fd.args[ 1 ] )->get(), STR( fd.args[ 2 ] )->get(), window );
+	return make< var_file_block_iterable_t >( FILE( fd.args[ 0 ] ), scanner );
+}
+
+var_base_t * fs_file_block_iterable_next( vm_state_t & vm, const fn_data_t & fd )
+{
+	var_file_block_iterable_t * it = FILE_BLOCK_ITERABLE( fd.args[ 0 ] );
+	var_base_t * res = nullptr;
+	if( !it->next( res ) ) return vm.nil;
+	return res;
+}
+
+var_base_t * fs_file_tell( vm_state_t & vm, const fn_data_t & fd )
+{
+	return make< var_int_t >( ( long )ftello( FILE( fd.args[ 0 ] )->get() ) );
+}
+
+// validates the number of bytes to read (args[ arg ]) and sets n to it
+static bool read_size_valid( vm_state_t & vm, const fn_data_t & fd, const size_t & arg, size_t & n )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ arg ]->type() != VT_INT ) {
+		src->fail( fd.idx, "expected int argument for number of bytes to read, found: %s",
+			   vm.type_name( fd.args[ arg ]->type() ).c_str() );
+		return false;
+	}
+	const mpz_class & num = INT( fd.args[ arg ] )->get();
+	if( sgn( num ) < 0 || !num.fits_ulong_p() ) {
+		src->fail( fd.idx, "number of bytes to read must be a non negative integer that fits an unsigned long" );
+		return false;
+	}
+	n = num.get_ui();
+	return true;
+}
+
+// reads up to n bytes with fread into data (replacing its contents), returns the number of bytes read
+// the string grows a chunk at a time, so a large n only costs memory for what the file actually has
+// (fread bypasses the stdio buffer for large sizes, reading straight into the string)
+static size_t fread_upto( FILE * const file, std::string & data, const size_t & n )
+{
+	size_t len = 0;
+	while( len < n ) {
+		const size_t want = std::min( n - len, FILE_READ_CHUNK_SIZE );
+		data.resize( len + want );
+		const size_t got = fread( & data[ len ], 1, want, file );
+		len += got;
+		if( got < want ) break;
+	}
+	data.resize( len );
+	return len;
+}
+
+// reads up to n bytes, returns nil at end of file
+var_base_t * fs_file_read( vm_state_t & vm, const fn_data_t & fd )
+{
+	size_t n;
+	if( !read_size_valid( vm, fd, 1, n ) ) return nullptr;
+	std::string data;
+	if( fread_upto( FILE( fd.args[ 0 ] )->get(), data, n ) == 0 ) return vm.nil;
+	return make< var_str_t >( data );
+}
+
+// reads up to n bytes in the given string, reusing its memory
+// returns the number of bytes read (the new size of the string)
+var_base_t * fs_file_read_into( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	FILE * const file = FILE( fd.args[ 0 ] )->get();
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		src->fail( fd.idx, "expected string argument for destination buffer, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	size_t n;
+	if( !read_size_valid( vm, fd, 2, n ) ) return nullptr;
+	return make< var_int_t >( fread_upto( file, STR( fd.args[ 1 ] )->get(), n ) );
+}
+
+var_base_t * fs_file_write( vm_state_t & vm, const fn_data_t & fd )
+{
+	FILE * const file = FILE( fd.args[ 0 ] )->get();
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for data to write, found: %s",
+						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	const std::string & data = STR( fd.args[ 1 ] )->get();
+	return make< var_int_t >( fwrite( data.data(), 1, data.size(), file ) );
+}
+
+// positional read straight from the file descriptor - does not move the file position
+var_base_t * fs_file_pread( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	FILE * const file = FILE( fd.args[ 0 ] )->get();
+	if( fd.args[ 1 ]->type() != VT_INT ) {
+		src->fail( fd.idx, "expected int argument for read offset, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	size_t n;
+	if( !read_size_valid( vm, fd, 2, n ) ) return nullptr;
+	off_t off = INT( fd.args[ 1 ] )->get().get_si();
+	// pending buffered writes must reach the descriptor first
+	fflush( file );
+	// grown a chunk at a time like fread_upto
+	std::string data;
+	size_t len = 0;
+	while( len < n ) {
+		if( len == data.size() ) data.resize( len + std::min( n - len, FILE_READ_CHUNK_SIZE ) );
+		ssize_t res = pread( fileno( file ), & data[ len ], data.size() - len, off + len );
+		if( res < 0 && errno == EINTR ) continue;
+		if( res <= 0 ) break;
+		len += res;
+	}
+	if( len == 0 ) return vm.nil;
+	data.resize( len );
+	return make< var_str_t >( data );
+}
+
+// positional write straight to the file descriptor - does not move the file position
+// returns the number of bytes written
+var_base_t * fs_file_pwrite( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	FILE * const file = FILE( fd.args[ 0 ] )->get();
+	if( fd.args[ 1 ]->type() != VT_INT ) {
+		src->fail( fd.idx, "expected int argument for write offset, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 2 ]->type() != VT_STR ) {
+		src->fail( fd.idx, "expected string argument for data to write, found: %s",
+			   vm.type_name( fd.args[ 2 ]->type() ).c_str() );
+		return nullptr;
+	}
+	off_t off = INT( fd.args[ 1 ] )->get().get_si();
+	const std::string & data = STR( fd.args[ 2 ] )->get();
+	fflush( file );
+	size_t len = 0;
+	while( len < data.size() ) {
+		ssize_t res = pwrite( fileno( file ), data.data() + len, data.size() - len, off + len );
+		if( res < 0 && errno == EINTR ) continue;
+		if( res <= 0 ) break;
+		len += res;
+	}
+	return make< var_int_t >( len );
+}
+
 var_base_t * fs_file_iterable_next( vm_state_t & vm, const fn_data_t & fd )
 {
 	var_file_iterable_t * it = FILE_ITERABLE( fd.args[ 0 ] );
@@ -235,6 +2007,134 @@ var_base_t * fs_file_iterable_next( vm_state_t & vm, const fn_data_t & fd )
 	return res;
 }
 
+var_base_t * fs_walk( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		src->fail( fd.idx, "expected string argument for directory name, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 2 ]->type() != VT_STR ) {
+		src->fail( fd.idx, "expected string argument for glob pattern, found: %s",
+			   vm.type_name( fd.args[ 2 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 3 ]->type() != VT_INT ) {
+		src->fail( fd.idx, "expected int argument for walk mode, found: %s",
+			   vm.type_name( fd.args[ 3 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 4 ]->type() != VT_INT ) {
+		src->fail( fd.idx, "expected int argument for maximum depth, found: %s",
+			   vm.type_name( fd.args[ 4 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 5 ]->type() != VT_BOOL ) {
+		src->fail( fd.idx, "expected boolean argument for following symbolic links, found: %s",
+			   vm.type_name( fd.args[ 5 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 6 ]->type() != VT_INT ) {
+		src->fail( fd.idx, "expected int argument for thread count, found: %s",
+			   vm.type_name( fd.args[ 6 ]->type() ).c_str() );
+		return nullptr;
+	}
+	std::string dir_str = STR( fd.args[ 1 ] )->get();
+	if( dir_str.size() > 0 && dir_str.back() != '/' ) dir_str += "/";
+	size_t threads = INT( fd.args[ 6 ] )->get().get_ui();
+	if( threads == 0 ) threads = std::max( std::thread::hardware_concurrency(), 1U );
+	std::shared_ptr< walker_t > walker( new walker_t( dir_str, STR( fd.args[ 2 ] )->get(),
+							  INT( fd.args[ 3 ] )->get().get_ui(),
+							  INT( fd.args[ 4 ] )->get().get_si(),
+							  BOOL( fd.args[ 5 ] )->get(), threads ) );
+	return make< var_walker_t >( walker );
+}
+
+var_base_t * fs_walker_next( vm_state_t & vm, const fn_data_t & fd )
+{
+	var_walker_t * it = WALKER( fd.args[ 0 ] );
+	var_base_t * res = nullptr;
+	if( !it->next( res ) ) return vm.nil;
+	return res;
+}
+
+var_base_t * fs_mmap( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		src->fail( fd.idx, "expected string argument for file name, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	const std::string & file_name = STR( fd.args[ 1 ] )->get();
+	int fdesc = open( file_name.c_str(), O_RDONLY );
+	if( fdesc < 0 ) {
+		src->fail( fd.idx, "failed to open file '%s': %s", file_name.c_str(), strerror( errno ) );
+		return nullptr;
+	}
+	struct stat st;
+	if( fstat( fdesc, & st ) < 0 ) {
+		src->fail( fd.idx, "failed to stat file '%s': %s", file_name.c_str(), strerror( errno ) );
+		close( fdesc );
+		return nullptr;
+	}
+	void * data = nullptr;
+	// an empty file cannot be mapped, it just has no lines
+	if( st.st_size > 0 ) {
+		data = mmap( nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fdesc, 0 );
+		if( data == MAP_FAILED ) {
+			src->fail( fd.idx, "failed to map file '%s': %s", file_name.c_str(), strerror( errno ) );
+			close( fdesc );
+			return nullptr;
+		}
+	}
+	close( fdesc );
+	std::shared_ptr< mmap_buf_t > buf( new mmap_buf_t( ( const char * )data, st.st_size ) );
+	return make< var_mmap_t >( buf );
+}
+
+var_base_t * fs_mmap_len( vm_state_t & vm, const fn_data_t & fd )
+{
+	return make< var_int_t >( MMAP( fd.args[ 0 ] )->get()->size() );
+}
+
+var_base_t * fs_mmap_line_count( vm_state_t & vm, const fn_data_t & fd )
+{
+	return make< var_int_t >( MMAP( fd.args[ 0 ] )->get()->line_count() );
+}
+
+var_base_t * fs_mmap_line( vm_state_t & vm, const fn_data_t & fd )
+{
+	if( fd.args[ 1 ]->type() != VT_INT ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected int argument for line number, found: %s",
+						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	const mpz_class & num = INT( fd.args[ 1 ] )->get();
+	// get_ui() would give the magnitude of a negative number
+	if( sgn( num ) < 0 || !num.fits_ulong_p() ) return vm.nil;
+	const char * beg;
+	size_t len;
+	if( !MMAP( fd.args[ 0 ] )->get()->line( num.get_ui(), beg, len ) ) {
+		return vm.nil;
+	}
+	return make< var_str_t >( std::string( beg, len ) );
+}
+
+var_base_t * fs_mmap_each_line( vm_state_t & vm, const fn_data_t & fd )
+{
+	return make< var_mmap_iterable_t >( MMAP( fd.args[ 0 ] )->get() );
+}
+
+var_base_t * fs_mmap_iterable_next( vm_state_t & vm, const fn_data_t & fd )
+{
+	var_mmap_iterable_t * it = MMAP_ITERABLE( fd.args[ 0 ] );
+	var_base_t * res = nullptr;
+	if( !it->next( res ) ) return vm.nil;
+	return res;
+}
+
 var_base_t * fs_walkdir( vm_state_t & vm, const fn_data_t & fd )
 {
 	srcfile_t * src = vm.src_stack.back()->src();
@@ -270,23 +2170,86 @@ INIT_MODULE( fs )
 	// get the type id for file_iterable type (register_type)
 	file_iterable_typeid = vm.register_new_type( "file_iterable_t", src_id, idx );
 
-	src->add_nativefn( "exists", fs_exists, 1 );
-	src->add_nativefn( "open_native", fs_open, 2 );
-	src->add_nativefn( "walkdir_native", fs_walkdir, 3 );
+	src->add_nativefn( "exists", PROF( fs_exists ), 1 );
+	src->add_nativefn( "open_native", PROF( fs_open ), 2 );
+	src->add_nativefn( "walkdir_native", PROF( fs_walkdir ), 3 );
+	src->add_nativefn( "walk_native", PROF( fs_walk ), 6 );
+	src->add_nativefn( "mmap", PROF( fs_mmap ), 1 );
+	src->add_nativefn( "read_all", PROF( fs_read_all ), 1 );
+	src->add_nativefn( "write_all", PROF( fs_write_all ), 2 );
+	src->add_nativefn( "replace_atomic", PROF( fs_replace_atomic ), 2 );
+	src->add_nativefn( "stat_native", PROF( fs_stat ), 2 );
+	src->add_nativefn( "stat_many_native", PROF( fs_stat_many ), 3 );
+	src->add_nativefn( "stat_cache", PROF( fs_stat_cache ), 1 );
+	src->add_nativefn( "stat_invalidate", PROF( fs_stat_invalidate ), 0, true );
+
+	// get the struct id for stat records
+	stat_struct_id = vm.register_struct_enum_id();
+	vm.set_typename( stat_struct_id, "stat_t" );
+
+	src->add_nativefn( "watch_native", PROF( fs_watch ), 4 );
+
+	// get the type id for watcher (register_type) and the struct id for its events
+	watcher_typeid = vm.register_new_type( "watcher_t", src_id, idx );
+	watch_event_struct_id = vm.register_struct_enum_id();
+	vm.set_typename( watch_event_struct_id, "watch_event_t" );
+
+	vm.add_typefn_native( watcher_typeid, "next_events_native", PROF( fs_watcher_next_events ), 1, src_id, idx );
+	vm.add_typefn_native( watcher_typeid,            "polling", PROF( fs_watcher_polling ),     0, src_id, idx );
+
+	vm.add_typefn_native( VT_FILE, "lines", PROF( fs_file_lines ), 0, src_id, idx );
+	vm.add_typefn_native( VT_FILE, "each_line_native", PROF( fs_file_each_line ), 2, src_id, idx );
+	vm.add_typefn_native( VT_FILE, "read_blocks", PROF( fs_file_read_blocks ), 2, src_id, idx );
+	vm.add_typefn_native( VT_FILE, "each_block_native", PROF( fs_file_each_block ), 3, src_id, idx );
+
+	vm.add_typefn_native( VT_FILE, "seek", PROF( fs_file_seek ), 2, src_id, idx );
+	vm.add_typefn_native( VT_FILE, "tell", PROF( fs_file_tell ), 0, src_id, idx );
 
-	vm.add_typefn_native( VT_FILE, "lines", fs_file_lines, 0, src_id, idx );
-	vm.add_typefn_native( VT_FILE, "each_line", fs_file_each_line, 0, src_id, idx );
-	vm.add_typefn_native( VT_FILE, "read_blocks", fs_file_read_blocks, 2, src_id, idx );
+	vm.add_typefn_native( VT_FILE,      "read", PROF( fs_file_read ),      1, src_id, idx );
+	vm.add_typefn_native( VT_FILE, "read_into", PROF( fs_file_read_into ), 2, src_id, idx );
+	vm.add_typefn_native( VT_FILE,     "write", PROF( fs_file_write ),     1, src_id, idx );
+	vm.add_typefn_native( VT_FILE,     "pread", PROF( fs_file_pread ),     2, src_id, idx );
+	vm.add_typefn_native( VT_FILE,    "pwrite", PROF( fs_file_pwrite ),    2, src_id, idx );
 
-	vm.add_typefn_native( VT_FILE, "seek", fs_file_seek, 2, src_id, idx );
+	vm.add_typefn_native( file_iterable_typeid, "next", PROF( fs_file_iterable_next ), 0, src_id, idx );
 
-	vm.add_typefn_native( file_iterable_typeid, "next", fs_file_iterable_next, 0, src_id, idx );
+	// get the type id for file block iterable (register_type)
+	file_block_iterable_typeid = vm.register_new_type( "file_block_iterable_t", src_id, idx );
+
+	vm.add_typefn_native( file_block_iterable_typeid, "next", PROF( fs_file_block_iterable_next ), 0, src_id, idx );
+
+	// get the type id for walker (register_type)
+	walker_typeid = vm.register_new_type( "walker_t", src_id, idx );
+
+	vm.add_typefn_native( walker_typeid, "next", PROF( fs_walker_next ), 0, src_id, idx );
+
+	// get the type ids for mmap and its iterable (register_type)
+	mmap_typeid = vm.register_new_type( "mmap_t", src_id, idx );
+	mmap_iterable_typeid = vm.register_new_type( "mmap_iterable_t", src_id, idx );
+
+	vm.add_typefn_native( mmap_typeid,        "len", PROF( fs_mmap_len ),        0, src_id, idx );
+	vm.add_typefn_native( mmap_typeid, "line_count", PROF( fs_mmap_line_count ), 0, src_id, idx );
+	vm.add_typefn_native( mmap_typeid,       "line", PROF( fs_mmap_line ),       1, src_id, idx );
+	vm.add_typefn_native( mmap_typeid,  "each_line", PROF( fs_mmap_each_line ),  0, src_id, idx );
+
+	vm.add_typefn_native( mmap_iterable_typeid, "next", PROF( fs_mmap_iterable_next ), 0, src_id, idx );
 
 	// constants
 	src->add_nativevar( "WALK_FILES", make_all< var_int_t >( WalkEntry::FILES, src_id, idx ) );
 	src->add_nativevar( "WALK_DIRS", make_all< var_int_t >( WalkEntry::DIRS, src_id, idx ) );
 	src->add_nativevar( "WALK_RECURSE", make_all< var_int_t >( WalkEntry::RECURSE, src_id, idx ) );
 
+	src->add_nativevar( "STAT_OTHER", make_all< var_int_t >( STAT_OTHER, src_id, idx ) );
+	src->add_nativevar( "STAT_FILE", make_all< var_int_t >( STAT_FILE, src_id, idx ) );
+	src->add_nativevar( "STAT_DIR", make_all< var_int_t >( STAT_DIR, src_id, idx ) );
+	src->add_nativevar( "STAT_LINK", make_all< var_int_t >( STAT_LINK, src_id, idx ) );
+
+	src->add_nativevar( "WATCH_CREATED", make_all< var_int_t >( WATCH_CREATED, src_id, idx ) );
+	src->add_nativevar( "WATCH_MODIFIED", make_all< var_int_t >( WATCH_MODIFIED, src_id, idx ) );
+	src->add_nativevar( "WATCH_DELETED", make_all< var_int_t >( WATCH_DELETED, src_id, idx ) );
+	src->add_nativevar( "WATCH_ATTRIB", make_all< var_int_t >( WATCH_ATTRIB, src_id, idx ) );
+	src->add_nativevar( "WATCH_OVERFLOW", make_all< var_int_t >( WATCH_OVERFLOW, src_id, idx ) );
+
 	src->add_nativevar( "SEEK_SET", make_all< var_int_t >( SEEK_SET, src_id, idx ) );
 	src->add_nativevar( "SEEK_CUR", make_all< var_int_t >( SEEK_CUR, src_id, idx ) );
 	src->add_nativevar( "SEEK_END", make_all< var_int_t >( SEEK_END, src_id, idx ) );
@@ -306,10 +2269,13 @@ void get_entries_internal( const std::string & dir_str, std::vector< var_base_t
 	while( ( ent = readdir( dir ) ) != NULL ) {
 		if( strcmp( ent->d_name, "." ) == 0 || strcmp( ent->d_name, ".." ) == 0 ) continue;
 		std::string entry = dir_str + ent->d_name;
-		if( ( !( flags & WalkEntry::RECURSE ) || ent->d_type != DT_DIR ) && !std::regex_match( entry, regex ) ) {
+		unsigned char type = ent->d_type;
+		struct stat st;
+		if( type == DT_UNKNOWN && lstat( entry.c_str(), & st ) == 0 ) type = IFTODT( st.st_mode );
+		if( ( !( flags & WalkEntry::RECURSE ) || type != DT_DIR ) && !std::regex_match( entry, regex ) ) {
 			continue;
 		}
-		if( ent->d_type == DT_DIR ) {
+		if( type == DT_DIR ) {
 			if( flags & WalkEntry::RECURSE ) {
 				get_entries_internal( entry + "/", v, flags, src_id, idx, regex );
 			} else if( flags & WalkEntry::DIRS ) {
@@ -0,0 +1,643 @@
+/*
+	Copyright (c) 2020, Electrux
+	All rights reserved.
+	Using the BSD 3-Clause license for the project,
+	main LICENSE file resides in project's root directory.
+	Please read that file and understand the license terms
+	before using or altering the project.
+*/
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+
+#include <fcntl.h>
+#include <unistd.h>
+#if defined( __x86_64__ )
+#include <nmmintrin.h>
+#endif
+
+#include <feral/VM/VM.hpp>
+
+#include "common/profile.hpp"
+
+enum HashAlgo {
+	HASH_XXH64,
+	HASH_CRC32C,
+	HASH_SHA256,
+	HASH_INVALID,
+};
+
+// size of the blocks in which files are read for hashing
+const size_t HASH_FILE_BLOCK_SIZE = 1024 * 1024;
+
+HashAlgo hash_algo( const std::string & name );
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////// Classes //////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// streaming hash state, updated with consecutive chunks of the data
+class hash_state_t
+{
+public:
+	virtual ~hash_state_t();
+
+	virtual hash_state_t * clone() const = 0;
+	virtual void reset() = 0;
+	virtual void update( const char * data, const size_t & len ) = 0;
+	// digest of the data so far, as lowercase hex - does not alter the state
+	virtual std::string hex_digest() const = 0;
+};
+hash_state_t::~hash_state_t() {}
+
+hash_state_t * hash_state_new( const HashAlgo & algo );
+
+static std::string to_hex( const unsigned char * data, const size_t & len )
+{
+	static const char digits[] = "0123456789abcdef";
+	std::string res( len * 2, '0' );
+	for( size_t i = 0; i < len; ++i ) {
+		res[ i * 2 ] = digits[ data[ i ] >> 4 ];
+		res[ i * 2 + 1 ] = digits[ data[ i ] & 0xf ];
+	}
+	return res;
+}
+
+// big endian hex, the way the reference implementations print the digests
+static std::string to_hex( const uint64_t & val, const size_t & bytes )
+{
+	unsigned char buf[ 8 ];
+	for( size_t i = 0; i < bytes; ++i ) buf[ i ] = val >> ( ( bytes - 1 - i ) * 8 );
+	return to_hex( buf, bytes );
+}
+
+static inline uint64_t read64le( const unsigned char * p )
+{
+	uint64_t v;
+	memcpy( & v, p, 8 );
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap64( v );
+#endif
+	return v;
+}
+
+static inline uint32_t read32le( const unsigned char * p )
+{
+	uint32_t v;
+	memcpy( & v, p, 4 );
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	v = __builtin_bswap32( v );
+#endif
+	return v;
+}
+
+static inline uint64_t rotl64( const uint64_t & x, const int & r ) { return ( x << r ) | ( x >> ( 64 - r ) ); }
+static inline uint32_t rotr32( const uint32_t & x, const int & r ) { return ( x >> r ) | ( x << ( 32 - r ) ); }
+
+// XXH64 - fast non cryptographic hash, compatible with the reference xxhash implementation
+class xxh64_t : public hash_state_t
+{
+	static const uint64_t P1 = 11400714785074694791ULL;
+	static const uint64_t P2 = 14029467366897019727ULL;
+	static const uint64_t P3 = 1609587929392839161ULL;
+	static const uint64_t P4 = 9650029242287828579ULL;
+	static const uint64_t P5 = 2870177450012600261ULL;
+
+	uint64_t m_acc[ 4 ];
+	unsigned char m_buf[ 32 ];
+	size_t m_buf_len;
+	uint64_t m_total;
+
+	static inline uint64_t round( uint64_t acc, const uint64_t & input );
+	static inline uint64_t merge( uint64_t acc, const uint64_t & val );
+public:
+	xxh64_t();
+
+	hash_state_t * clone() const;
+	void reset();
+	void update( const char * data, const size_t & len );
+	std::string hex_digest() const;
+};
+
+xxh64_t::xxh64_t() { reset(); }
+
+inline uint64_t xxh64_t::round( uint64_t acc, const uint64_t & input )
+{
+	acc += input * P2;
+	acc = rotl64( acc, 31 );
+	return acc * P1;
+}
+
+inline uint64_t xxh64_t::merge( uint64_t acc, const uint64_t & val )
+{
+	acc ^= round( 0, val );
+	return acc * P1 + P4;
+}
+
+hash_state_t * xxh64_t::clone() const { return new xxh64_t( * this ); }
+
+void xxh64_t::reset()
+{
+	m_acc[ 0 ] = P1 + P2;
+	m_acc[ 1 ] = P2;
+	m_acc[ 2 ] = 0;
+	m_acc[ 3 ] = -P1;
+	m_buf_len = 0;
+	m_total = 0;
+}
+
+void xxh64_t::update( const char * data, const size_t & len )
+{
+	const unsigned char * p = ( const unsigned char * )data;
+	const unsigned char * const end = p + len;
+	m_total += len;
+	if( m_buf_len + len < 32 ) {
+		memcpy( m_buf + m_buf_len, p, len );
+		m_buf_len += len;
+		return;
+	}
+	if( m_buf_len > 0 ) {
+		memcpy( m_buf + m_buf_len, p, 32 - m_buf_len );
+		p += 32 - m_buf_len;
+		for( int i = 0; i < 4; ++i ) m_acc[ i ] = round( m_acc[ i ], read64le( m_buf + i * 8 ) );
+		m_buf_len = 0;
+	}
+	// the four lanes are independent, so the compiler can keep them all in flight
+	uint64_t a0 = m_acc[ 0 ], a1 = m_acc[ 1 ], a2 = m_acc[ 2 ], a3 = m_acc[ 3 ];
+	for( ; p + 32 <= end; p += 32 ) {
+		a0 = round( a0, read64le( p ) );
+		a1 = round( a1, read64le( p + 8 ) );
+		a2 = round( a2, read64le( p + 16 ) );
+		a3 = round( a3, read64le( p + 24 ) );
+	}
+	m_acc[ 0 ] = a0; m_acc[ 1 ] = a1; m_acc[ 2 ] = a2; m_acc[ 3 ] = a3;
+	m_buf_len = end - p;
+	memcpy( m_buf, p, m_buf_len );
+}
+
+std::string xxh64_t::hex_digest() const
+{
+	uint64_t h;
+	if( m_total >= 32 ) {
+		h = rotl64( m_acc[ 0 ], 1 ) + rotl64( m_acc[ 1 ], 7 ) + rotl64( m_acc[ 2 ], 12 ) + rotl64( m_acc[ 3 ], 18 );
+		for( int i = 0; i < 4; ++i ) h = merge( h, m_acc[ i ] );
+	} else {
+		h = m_acc[ 2 ] + P5;
+	}
+	h += m_total;
+	const unsigned char * p = m_buf;
+	const unsigned char * const end = m_buf + m_buf_len;
+	for( ; p + 8 <= end; p += 8 ) {
+		h ^= round( 0, read64le( p ) );
+		h = rotl64( h, 27 ) * P1 + P4;
+	}
+	if( p + 4 <= end ) {
+		h ^= ( uint64_t )read32le( p ) * P1;
+		h = rotl64( h, 23 ) * P2 + P3;
+		p += 4;
+	}
+	for( ; p < end; ++p ) {
+		h ^= ( * p ) * P5;
+		h = rotl64( h, 11 ) * P1;
+	}
+	h ^= h >> 33;
+	h *= P2;
+	h ^= h >> 29;
+	h *= P3;
+	h ^= h >> 32;
+	return to_hex( h, 8 );
+}
+
+// CRC-32C (Castagnoli) - uses the SSE 4.2 crc32 instruction when the cpu has it,
+// else a slice-by-8 table implementation
+class crc32c_t : public hash_state_t
+{
+	uint32_t m_crc;
+
+	static uint32_t update_sw( uint32_t crc, const unsigned char * p, size_t len );
+#if defined( __x86_64__ )
+	static uint32_t update_hw( uint32_t crc, const unsigned char * p, size_t len );
+#endif
+public:
+	crc32c_t();
+
+	hash_state_t * clone() const;
+	void reset();
+	void update( const char * data, const size_t & len );
+	std::string hex_digest() const;
+};
+
+crc32c_t::crc32c_t() { reset(); }
+
+hash_state_t * crc32c_t::clone() const { return new crc32c_t( * this ); }
+
+void crc32c_t::reset() { m_crc = 0xffffffff; }
+
+void crc32c_t::update( const char * data, const size_t & len )
+{
+#if defined( __x86_64__ )
+	static const bool has_hw = __builtin_cpu_supports( "sse4.2" );
+	if( has_hw ) {
+		m_crc = update_hw( m_crc, ( const unsigned char * )data, len );
+		return;
+	}
+#endif
+	m_crc = update_sw( m_crc, ( const unsigned char * )data, len );
+}
+
+std::string crc32c_t::hex_digest() const { return to_hex( ~m_crc, 4 ); }
+
+uint32_t crc32c_t::update_sw( uint32_t crc, const unsigned char * p, size_t len )
+{
+	struct tables_t
+	{
+		uint32_t t[ 8 ][ 256 ];
+		tables_t()
+		{
+			for( uint32_t i = 0; i < 256; ++i ) {
+				uint32_t c = i;
+				for( int k = 0; k < 8; ++k ) c = c & 1 ? ( c >> 1 ) ^ 0x82f63b78 : c >> 1;
+				t[ 0 ][ i ] = c;
+			}
+			for( uint32_t i = 0; i < 256; ++i ) {
+				for( int k = 1; k < 8; ++k ) t[ k ][ i ] = ( t[ k - 1 ][ i ] >> 8 ) ^ t[ 0 ][ t[ k - 1 ][ i ] & 0xff ];
+			}
+		}
+	};
+	static const tables_t tables;
+	const uint32_t ( & t )[ 8 ][ 256 ] = tables.t;
+	for( ; len >= 8; p += 8, len -= 8 ) {
+		const uint32_t lo = read32le( p ) ^ crc;
+		const uint32_t hi = read32le( p + 4 );
+		crc = t[ 7 ][ lo & 0xff ] ^ t[ 6 ][ ( lo >> 8 ) & 0xff ] ^ t[ 5 ][ ( lo >> 16 ) & 0xff ] ^ t[ 4 ][ lo >> 24 ] ^
+		      t[ 3 ][ hi & 0xff ] ^ t[ 2 ][ ( hi >> 8 ) & 0xff ] ^ t[ 1 ][ ( hi >> 16 ) & 0xff ] ^ t[ 0 ][ hi >> 24 ];
+	}
+	for( ; len > 0; ++p, --len ) crc = ( crc >> 8 ) ^ t[ 0 ][ ( crc ^ * p ) & 0xff ];
+	return crc;
+}
+
+#if defined( __x86_64__ )
+__attribute__( ( target( "sse4.2" ) ) )
+uint32_t crc32c_t::update_hw( uint32_t crc, const unsigned char * p, size_t len )
+{
+	uint64_t c = crc;
+	for( ; len >= 8; p += 8, len -= 8 ) {
+		uint64_t v;
+		memcpy( & v, p, 8 );
+		c = _mm_crc32_u64( c, v );
+	}
+	crc = c;
+	for( ; len > 0; ++p, --len ) crc = _mm_crc32_u8( crc, * p );
+	return crc;
+}
+#endif
+
+// SHA-256 (FIPS 180-4)
+class sha256_t : public hash_state_t
+{
+	uint32_t m_state[ 8 ];
+	unsigned char m_buf[ 64 ];
+	size_t m_buf_len;
+	uint64_t m_total;
+
+	static void transform( uint32_t state[ 8 ], const unsigned char * block );
+public:
+	sha256_t();
+
+	hash_state_t * clone() const;
+	void reset();
+	void update( const char * data, const size_t & len );
+	std::string hex_digest() const;
+};
+
+sha256_t::sha256_t() { reset(); }
+
+hash_state_t * sha256_t::clone() const { return new sha256_t( * this ); }
+
+void sha256_t::reset()
+{
+	static const uint32_t init[ 8 ] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+	};
+	memcpy( m_state, init, sizeof( init ) );
+	m_buf_len = 0;
+	m_total = 0;
+}
+
+void sha256_t::transform( uint32_t state[ 8 ], const unsigned char * block )
+{
+	static const uint32_t k[ 64 ] = {
+		0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+		0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+		0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+		0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+		0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+		0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+		0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+		0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+	};
+	uint32_t w[ 64 ];
+	for( int i = 0; i < 16; ++i ) {
+		w[ i ] = ( uint32_t )block[ i * 4 ] << 24 | ( uint32_t )block[ i * 4 + 1 ] << 16 |
+			 ( uint32_t )block[ i * 4 + 2 ] << 8 | block[ i * 4 + 3 ];
+	}
+	for( int i = 16; i < 64; ++i ) {
+		const uint32_t s0 = rotr32( w[ i - 15 ], 7 ) ^ rotr32( w[ i - 15 ], 18 ) ^ ( w[ i - 15 ] >> 3 );
+		const uint32_t s1 = rotr32( w[ i - 2 ], 17 ) ^ rotr32( w[ i - 2 ], 19 ) ^ ( w[ i - 2 ] >> 10 );
+		w[ i ] = w[ i - 16 ] + s0 + w[ i - 7 ] + s1;
+	}
+	uint32_t a = state[ 0 ], b = state[ 1 ], c = state[ 2 ], d = state[ 3 ];
+	uint32_t e = state[ 4 ], f = state[ 5 ], g = state[ 6 ], h = state[ 7 ];
+	for( int i = 0; i < 64; ++i ) {
+		const uint32_t t1 = h + ( rotr32( e, 6 ) ^ rotr32( e, 11 ) ^ rotr32( e, 25 ) ) + ( ( e & f ) ^ ( ~e & g ) ) + k[ i ] + w[ i ];
+		const uint32_t t2 = ( rotr32( a, 2 ) ^ rotr32( a, 13 ) ^ rotr32( a, 22 ) ) + ( ( a & b ) ^ ( a & c ) ^ ( b & c ) );
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	state[ 0 ] += a; state[ 1 ] += b; state[ 2 ] += c; state[ 3 ] += d;
+	state[ 4 ] += e; state[ 5 ] += f; state[ 6 ] += g; state[ 7 ] += h;
+}
+
+void sha256_t::update( const char * data, const size_t & len )
+{
+	const unsigned char * p = ( const unsigned char * )data;
+	const unsigned char * const end = p + len;
+	m_total += len;
+	if( m_buf_len > 0 ) {
+		const size_t n = std::min( ( size_t )( 64 - m_buf_len ), len );
+		memcpy( m_buf + m_buf_len, p, n );
+		m_buf_len += n;
+		p += n;
+		if( m_buf_len < 64 ) return;
+		transform( m_state, m_buf );
+		m_buf_len = 0;
+	}
+	for( ; p + 64 <= end; p += 64 ) transform( m_state, p );
+	m_buf_len = end - p;
+	memcpy( m_buf, p, m_buf_len );
+}
+
+std::string sha256_t::hex_digest() const
+{
+	uint32_t state[ 8 ];
+	memcpy( state, m_state, sizeof( state ) );
+	unsigned char tail[ 128 ];
+	memcpy( tail, m_buf, m_buf_len );
+	tail[ m_buf_len ] = 0x80;
+	const size_t tail_len = m_buf_len + 9 <= 64 ? 64 : 128;
+	memset( tail + m_buf_len + 1, 0, tail_len - m_buf_len - 1 );
+	const uint64_t bits = m_total * 8;
+	for( int i = 0; i < 8; ++i ) tail[ tail_len - 1 - i ] = bits >> ( i * 8 );
+	for( size_t off = 0; off < tail_len; off += 64 ) transform( state, tail + off );
+	unsigned char out[ 32 ];
+	for( int i = 0; i < 8; ++i ) {
+		out[ i * 4 ] = state[ i ] >> 24;
+		out[ i * 4 + 1 ] = state[ i ] >> 16;
+		out[ i * 4 + 2 ] = state[ i ] >> 8;
+		out[ i * 4 + 3 ] = state[ i ];
+	}
+	return to_hex( out, 32 );
+}
+
+// initialize this in the init_hash function
+static int hasher_typeid;
+
+class var_hasher_t : public var_base_t
+{
+	std::unique_ptr< hash_state_t > m_state;
+public:
+	var_hasher_t( hash_state_t * state, const size_t & src_id, const size_t & idx );
+
+	var_base_t * copy( const size_t & src_id, const size_t & idx );
+	void set( var_base_t * from );
+
+	hash_state_t * get();
+};
+#define HASHER( x ) static_cast< var_hasher_t * >( x )
+
+var_hasher_t::var_hasher_t( hash_state_t * state, const size_t & src_id, const size_t & idx )
+	: var_base_t( hasher_typeid, src_id, idx ), m_state( state ) {}
+
+var_base_t * var_hasher_t::copy( const size_t & src_id, const size_t & idx )
+{
+	return new var_hasher_t( m_state->clone(), src_id, idx );
+}
+void var_hasher_t::set( var_base_t * from )
+{
+	m_state.reset( HASHER( from )->m_state->clone() );
+}
+
+hash_state_t * var_hasher_t::get() { return m_state.get(); }
+
+// hashes the file in large blocks, returns 0 on success, else the errno
+static int hash_file_internal( const std::string & path, const HashAlgo & algo, std::string & digest );
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////// Functions /////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// validates the algorithm name in the given argument
+static bool algo_arg( vm_state_t & vm, const fn_data_t & fd, const size_t & arg, HashAlgo & algo )
+{
+	if( fd.args[ arg ]->type() != VT_STR ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for algorithm, found: %s",
+						  vm.type_name( fd.args[ arg ]->type() ).c_str() );
+		return false;
+	}
+	algo = hash_algo( STR( fd.args[ arg ] )->get() );
+	if( algo == HASH_INVALID ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "unknown hash algorithm '%s' (expected xxh64, crc32c or sha256)",
+						  STR( fd.args[ arg ] )->get().c_str() );
+		return false;
+	}
+	return true;
+}
+
+var_base_t * hash_str( vm_state_t & vm, const fn_data_t & fd )
+{
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for data, found: %s",
+						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	HashAlgo algo;
+	if( !algo_arg( vm, fd, 2, algo ) ) return nullptr;
+	std::unique_ptr< hash_state_t > state( hash_state_new( algo ) );
+	const std::string & data = STR( fd.args[ 1 ] )->get();
+	state->update( data.data(), data.size() );
+	return make< var_str_t >( state->hex_digest() );
+}
+
+var_base_t * hash_file( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		src->fail( fd.idx, "expected string argument for file name, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	HashAlgo algo;
+	if( !algo_arg( vm, fd, 2, algo ) ) return nullptr;
+	const std::string & file_name = STR( fd.args[ 1 ] )->get();
+	std::string digest;
+	int err = hash_file_internal( file_name, algo, digest );
+	if( err != 0 ) {
+		src->fail( fd.idx, "failed to hash file '%s': %s", file_name.c_str(), strerror( err ) );
+		return nullptr;
+	}
+	return make< var_str_t >( digest );
+}
+
+// hashes the files in parallel, returns a vector of the digests in the same order
+// with nil for the files which could not be read
+var_base_t * hash_many( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_VEC ) {
+		src->fail( fd.idx, "expected vector argument for file names, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	HashAlgo algo;
+	if( !algo_arg( vm, fd, 2, algo ) ) return nullptr;
+	if( fd.args[ 3 ]->type() != VT_INT ) {
+		src->fail( fd.idx, "expected int argument for threads, found: %s",
+			   vm.type_name( fd.args[ 3 ]->type() ).c_str() );
+		return nullptr;
+	}
+	const std::vector< var_base_t * > & vec = VEC( fd.args[ 1 ] )->get();
+	std::vector< const std::string * > paths;
+	paths.reserve( vec.size() );
+	for( auto & e : vec ) {
+		if( e->type() != VT_STR ) {
+			src->fail( fd.idx, "expected vector of strings for file names, found element: %s",
+				   vm.type_name( e->type() ).c_str() );
+			return nullptr;
+		}
+		paths.push_back( & STR( e )->get() );
+	}
+	long threads = INT( fd.args[ 3 ] )->get().get_si();
+	if( threads <= 0 ) threads = std::max( std::thread::hardware_concurrency(), 1U );
+	threads = std::min( ( size_t )threads, std::max( paths.size(), ( size_t )1 ) );
+
+	std::vector< std::string > digests( paths.size() );
+	std::vector< int > errs( paths.size() );
+	std::atomic< size_t > next( 0 );
+	auto worker = [ & ]() {
+		for( size_t i = next++; i < paths.size(); i = next++ ) {
+			errs[ i ] = hash_file_internal( * paths[ i ], algo, digests[ i ] );
+		}
+	};
+	std::vector< std::thread > pool;
+	for( long i = 1; i < threads; ++i ) pool.emplace_back( worker );
+	worker();
+	for( auto & t : pool ) t.join();
+
+	std::vector< var_base_t * > res;
+	res.reserve( digests.size() );
+	for( size_t i = 0; i < digests.size(); ++i ) {
+		if( errs[ i ] != 0 ) {
+			var_iref( vm.nil );
+			res.push_back( vm.nil );
+			continue;
+		}
+		res.push_back( new var_str_t( digests[ i ], fd.src_id, fd.idx ) );
+	}
+	return make< var_vec_t >( res );
+}
+
+var_base_t * hash_new_hasher( vm_state_t & vm, const fn_data_t & fd )
+{
+	HashAlgo algo;
+	if( !algo_arg( vm, fd, 1, algo ) ) return nullptr;
+	return make< var_hasher_t >( hash_state_new( algo ) );
+}
+
+var_base_t * hasher_update( vm_state_t & vm, const fn_data_t & fd )
+{
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for data, found: %s",
+						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	const std::string & data = STR( fd.args[ 1 ] )->get();
+	HASHER( fd.args[ 0 ] )->get()->update( data.data(), data.size() );
+	return fd.args[ 0 ];
+}
+
+var_base_t * hasher_digest( vm_state_t & vm, const fn_data_t & fd )
+{
+	return make< var_str_t >( HASHER( fd.args[ 0 ] )->get()->hex_digest() );
+}
+
+var_base_t * hasher_reset( vm_state_t & vm, const fn_data_t & fd )
+{
+	HASHER( fd.args[ 0 ] )->get()->reset();
+	return fd.args[ 0 ];
+}
+
+INIT_MODULE( hash )
+{
+	var_src_t * src = vm.src_stack.back();
+
+	src->add_nativefn( "hash_native", PROF( hash_str ), 2 );
+	src->add_nativefn( "hash_file_native", PROF( hash_file ), 2 );
+	src->add_nativefn( "hash_many_native", PROF( hash_many ), 3 );
+	src->add_nativefn( "hasher_native", PROF( hash_new_hasher ), 1 );
+
+	// get the type id for hasher (register_type)
+	hasher_typeid = vm.register_new_type( "hasher_t", src_id, idx );
+
+	vm.add_typefn_native( hasher_typeid, "update", PROF( hasher_update ), 1, src_id, idx );
+	vm.add_typefn_native( hasher_typeid, "digest", PROF( hasher_digest ), 0, src_id, idx );
+	vm.add_typefn_native( hasher_typeid,  "reset", PROF( hasher_reset ),  0, src_id, idx );
+
+	return true;
+}
+
+HashAlgo hash_algo( const std::string & name )
+{
+	if( name == "xxh64" ) return HASH_XXH64;
+	if( name == "crc32c" ) return HASH_CRC32C;
+	if( name == "sha256" ) return HASH_SHA256;
+	return HASH_INVALID;
+}
+
+hash_state_t * hash_state_new( const HashAlgo & algo )
+{
+	switch( algo ) {
+	case HASH_XXH64: return new xxh64_t();
+	case HASH_CRC32C: return new crc32c_t();
+	case HASH_SHA256: return new sha256_t();
+	default: return nullptr;
+	}
+}
+
+static int hash_file_internal( const std::string & path, const HashAlgo & algo, std::string & digest )
+{
+	int fdesc = open( path.c_str(), O_RDONLY | O_CLOEXEC );
+	if( fdesc < 0 ) return errno;
+#if defined( POSIX_FADV_SEQUENTIAL )
+	posix_fadvise( fdesc, 0, 0, POSIX_FADV_SEQUENTIAL );
+#endif
+	std::unique_ptr< hash_state_t > state( hash_state_new( algo ) );
+	std::vector< char > buf( HASH_FILE_BLOCK_SIZE );
+	while( true ) {
+		ssize_t len = read( fdesc, buf.data(), buf.size() );
+		if( len < 0 && errno == EINTR ) continue;
+		if( len < 0 ) {
+			int err = errno;
+			close( fdesc );
+			return err;
+		}
+		if( len == 0 ) break;
+		state->update( buf.data(), len );
+	}
+	close( fdesc );
+	digest = state->hex_digest();
+	return 0;
+}
@@ -7,11 +7,367 @@
 	before using or altering the project.
 */
 
+#include <cerrno>
+#include <mutex>
+#include <memory>
+#include <thread>
+#include <condition_variable>
+#include <unistd.h>
+#include <sys/stat.h>
+
 #include <feral/VM/VM.hpp>
 
-const size_t MAX_C_STR_LEN = 1025;
-extern std::unordered_map< std::string, const char * > COL;
-int apply_colors( std::string & str );
+#include "common/profile.hpp"
+
+// size of the chunks in which stdin is pulled into the shared buffer
+const size_t STDIN_BLOCK_SIZE = 64 * 1024;
+// size of the direct reads done by read_all() once the buffer is drained
+const size_t STDIN_LARGE_BLOCK_SIZE = 1024 * 1024;
+
+// color templates up to this length are cached when printed through cprint & co.
+const size_t COL_TMPL_CACHE_MAX_LEN = 256;
+// number of compiled templates after which the cache is dropped and rebuilt
+const size_t COL_TMPL_CACHE_MAX_ENTRIES = 1024;
+
+// whether color codes are emitted for stdout/stderr (set in init_io)
+static bool stdout_col;
+static bool stderr_col;
+
+struct col_tmpl_t;
+
+std::shared_ptr< const col_tmpl_t > col_tmpl_get( const std::string & fmt );
+void col_render( const std::string & str, std::string & out, const bool & with_col );
+
+bool fmt_render( vm_state_t & vm, const fn_data_t & fd, const size_t & fmt_arg, std::string & out );
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////// Classes //////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// buffered reader over the stdin file descriptor, shared by all the
+// input functions so that none of them loses data read ahead by another
+class stdin_buf_t
+{
+	std::vector< char > m_buf;
+	size_t m_beg;
+	size_t m_end;
+	bool m_eof;
+
+	bool fill();
+public:
+	stdin_buf_t();
+
+	bool read_line( std::string & line );
+	bool read( std::string & data, const size_t & n );
+	void read_all( std::string & data );
+};
+
+static stdin_buf_t stdin_buf;
+
+stdin_buf_t::stdin_buf_t() : m_buf( STDIN_BLOCK_SIZE ), m_beg( 0 ), m_end( 0 ), m_eof( false ) {}
+
+// pulls the next block from stdin, returns false once EOF (or an error) is hit
+bool stdin_buf_t::fill()
+{
+	if( m_eof ) return false;
+	m_beg = m_end = 0;
+	ssize_t res;
+	while( ( res = ::read( STDIN_FILENO, m_buf.data(), m_buf.size() ) ) < 0 && errno == EINTR );
+	if( res <= 0 ) {
+		m_eof = true;
+		return false;
+	}
+	m_end = res;
+	return true;
+}
+
+// reads a line of any length, without the line ending
+// returns false only if EOF is reached before any data is read
+bool stdin_buf_t::read_line( std::string & line )
+{
+	line.clear();
+	bool found = false;
+	while( true ) {
+		if( m_beg == m_end && !fill() ) break;
+		found = true;
+		const char * beg = m_buf.data() + m_beg;
+		const char * nl = ( const char * )memchr( beg, '\n', m_end - m_beg );
+		if( nl == nullptr ) {
+			line.append( beg, m_end - m_beg );
+			m_beg = m_end;
+			continue;
+		}
+		line.append( beg, nl - beg );
+		m_beg += nl - beg + 1;
+		break;
+	}
+	if( !line.empty() && line.back() == '\r' ) line.pop_back();
+	return found;
+}
+
+// reads up to n bytes (less only at EOF), returns false if nothing could be read
+bool stdin_buf_t::read( std::string & data, const size_t & n )
+{
+	data.clear();
+	while( data.size() < n ) {
+		if( m_beg == m_end && !fill() ) break;
+		size_t count = std::min( n - data.size(), m_end - m_beg );
+		data.append( m_buf.data() + m_beg, count );
+		m_beg += count;
+	}
+	return !data.empty();
+}
+
+// reads everything until EOF, bypassing the buffer after draining it
+void stdin_buf_t::read_all( std::string & data )
+{
+	data.assign( m_buf.data() + m_beg, m_end - m_beg );
+	m_beg = m_end = 0;
+	if( m_eof ) return;
+
+	struct stat st;
+	if( fstat( STDIN_FILENO, & st ) == 0 && S_ISREG( st.st_mode ) && st.st_size > 0 ) {
+		data.reserve( data.size() + st.st_size );
+	}
+	size_t len = data.size();
+	while( true ) {
+		data.resize( len + STDIN_LARGE_BLOCK_SIZE );
+		ssize_t res = ::read( STDIN_FILENO, & data[ len ], STDIN_LARGE_BLOCK_SIZE );
+		if( res < 0 && errno == EINTR ) continue;
+		if( res <= 0 ) break;
+		len += res;
+	}
+	data.resize( len );
+	m_eof = true;
+}
+
+// color template, parsed once into its final output, both with
+// and without the color codes (for streams which are not a terminal)
+struct col_tmpl_t
+{
+	std::string colored;
+	std::string plain;
+
+	col_tmpl_t( const std::string & fmt );
+	inline const std::string & get( const bool & with_col ) const { return with_col ? colored : plain; }
+};
+
+// bounded multi producer queue of records drained by a dedicated writer
+// thread, so that a slow disk or a full pipe does not stall the interpreter
+class async_sink_t
+{
+	var_file_t * m_file;
+	// ring buffer of capacity m_queue.size()
+	std::vector< std::string > m_queue;
+	size_t m_head;
+	size_t m_count;
+	size_t m_batch;
+	bool m_block;
+	// records which are queued or being written
+	size_t m_pending;
+	size_t m_dropped;
+	bool m_closed;
+	std::mutex m_mtx;
+	std::condition_variable m_not_empty;
+	std::condition_variable m_not_full;
+	std::condition_variable m_drained;
+	std::thread m_writer;
+
+	void run();
+public:
+	async_sink_t( var_file_t * file, const size_t & capacity, const size_t & batch, const bool & block );
+	~async_sink_t();
+
+	bool push( std::string & rec );
+	void flush();
+	void close();
+
+	size_t depth();
+	size_t dropped();
+	bool closed();
+};
+
+// initialize these in the init_io function
+static int stdin_iterable_typeid;
+static int col_tmpl_typeid;
+static int async_sink_typeid;
+
+class var_async_sink_t : public var_base_t
+{
+	std::shared_ptr< async_sink_t > m_sink;
+public:
+	var_async_sink_t( const std::shared_ptr< async_sink_t > & sink, const size_t & src_id, const size_t & idx );
+
+	var_base_t * copy( const size_t & src_id, const size_t & idx );
+	void set( var_base_t * from );
+
+	inline async_sink_t & get() { return * m_sink; }
+};
+#define ASYNC_SINK( x ) static_cast< var_async_sink_t * >( x )
+
+async_sink_t::async_sink_t( var_file_t * file, const size_t & capacity, const size_t & batch, const bool & block )
+	: m_file( file ), m_queue( capacity ), m_head( 0 ), m_count( 0 ), m_batch( batch ),
+	  m_block( block ), m_pending( 0 ), m_dropped( 0 ), m_closed( false )
+{
+	var_iref( m_file );
+	m_writer = std::thread( & async_sink_t::run, this );
+}
+async_sink_t::~async_sink_t()
+{
+	close();
+	var_dref( m_file );
+}
+
+void async_sink_t::run()
+{
+	std::vector< std::string > batch;
+	batch.reserve( m_batch );
+	FILE * const file = m_file->get();
+	std::unique_lock< std::mutex > lock( m_mtx );
+	while( true ) {
+		while( m_count == 0 && !m_closed ) m_not_empty.wait( lock );
+		if( m_count == 0 ) break;
+		while( m_count > 0 && batch.size() < m_batch ) {
+			batch.push_back( std::move( m_queue[ m_head ] ) );
+			m_head = ( m_head + 1 ) % m_queue.size();
+			--m_count;
+		}
+		m_not_full.notify_all();
+		lock.unlock();
+		for( auto & rec : batch ) fwrite( rec.data(), 1, rec.size(), file );
+		fflush( file );
+		lock.lock();
+		m_pending -= batch.size();
+		batch.clear();
+		if( m_pending == 0 ) m_drained.notify_all();
+	}
+}
+
+// false if the record was dropped (queue full and not blocking, or sink closed)
+bool async_sink_t::push( std::string & rec )
+{
+	std::unique_lock< std::mutex > lock( m_mtx );
+	if( m_block ) {
+		while( m_count == m_queue.size() && !m_closed ) m_not_full.wait( lock );
+	}
+	if( m_closed || m_count == m_queue.size() ) {
+		++m_dropped;
+		return false;
+	}
+	m_queue[ ( m_head + m_count ) % m_queue.size() ].swap( rec );
+	++m_count;
+	++m_pending;
+	m_not_empty.notify_one();
+	return true;
+}
+
+// waits until everything queued so far is written out
+void async_sink_t::flush()
+{
+	std::unique_lock< std::mutex > lock( m_mtx );
+	while( m_pending > 0 ) m_drained.wait( lock );
+}
+
+// writes out whatever is queued and stops the writer thread
+void async_sink_t::close()
+{
+	{
+		std::unique_lock< std::mutex > lock( m_mtx );
+		if( m_closed ) return;
+		m_closed = true;
+	}
+	m_not_empty.notify_all();
+	m_not_full.notify_all();
+	m_writer.join();
+}
+
+size_t async_sink_t::depth()
+{
+	std::unique_lock< std::mutex > lock( m_mtx );
+	return m_count;
+}
+size_t async_sink_t::dropped()
+{
+	std::unique_lock< std::mutex > lock( m_mtx );
+	return m_dropped;
+}
+bool async_sink_t::closed()
+{
+	std::unique_lock< std::mutex > lock( m_mtx );
+	return m_closed;
+}
+
+var_async_sink_t::var_async_sink_t( const std::shared_ptr< async_sink_t > & sink, const size_t & src_id, const size_t & idx )
+	: var_base_t( async_sink_typeid, src_id, idx ), m_sink( sink ) {}
+
+var_base_t * var_async_sink_t::copy( const size_t & src_id, const size_t & idx )
+{
+	return new var_async_sink_t( m_sink, src_id, idx );
+}
+void var_async_sink_t::set( var_base_t * from )
+{
+	m_sink = ASYNC_SINK( from )->m_sink;
+}
+
+class var_col_tmpl_t : public var_base_t
+{
+	std::shared_ptr< const col_tmpl_t > m_tmpl;
+public:
+	var_col_tmpl_t( const std::shared_ptr< const col_tmpl_t > & tmpl, const size_t & src_id, const size_t & idx );
+
+	var_base_t * copy( const size_t & src_id, const size_t & idx );
+	void set( var_base_t * from );
+
+	inline const col_tmpl_t & get() const { return * m_tmpl; }
+};
+#define COL_TMPL( x ) static_cast< var_col_tmpl_t * >( x )
+
+var_col_tmpl_t::var_col_tmpl_t( const std::shared_ptr< const col_tmpl_t > & tmpl, const size_t & src_id, const size_t & idx )
+	: var_base_t( col_tmpl_typeid, src_id, idx ), m_tmpl( tmpl ) {}
+
+var_base_t * var_col_tmpl_t::copy( const size_t & src_id, const size_t & idx )
+{
+	return new var_col_tmpl_t( m_tmpl, src_id, idx );
+}
+void var_col_tmpl_t::set( var_base_t * from )
+{
+	m_tmpl = COL_TMPL( from )->m_tmpl;
+}
+
+
+class var_stdin_iterable_t : public var_base_t
+{
+	// reused for every line so that its allocation grows only once
+	std::string m_line;
+public:
+	var_stdin_iterable_t( const size_t & src_id, const size_t & idx );
+
+	var_base_t * copy( const size_t & src_id, const size_t & idx );
+	void set( var_base_t * from );
+
+	bool next( var_base_t * & val );
+};
+#define STDIN_ITERABLE( x ) static_cast< var_stdin_iterable_t * >( x )
+
+var_stdin_iterable_t::var_stdin_iterable_t( const size_t & src_id, const size_t & idx )
+	: var_base_t( stdin_iterable_typeid, src_id, idx ) {}
+
+var_base_t * var_stdin_iterable_t::copy( const size_t & src_id, const size_t & idx )
+{
+	return new var_stdin_iterable_t( src_id, idx );
+}
+void var_stdin_iterable_t::set( var_base_t * from ) {}
+
+bool var_stdin_iterable_t::next( var_base_t * & val )
+{
+	if( !stdin_buf.read_line( m_line ) ) return false;
+	val = make< var_str_t >( m_line );
+	return true;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////// Functions /////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 var_base_t * print( vm_state_t & vm, const fn_data_t & fd )
 {
@@ -87,60 +443,175 @@ var_base_t * fprintln( vm_state_t & vm, const fn_data_t & fd )
 	return vm.nil;
 }
 
-var_base_t * col_print( vm_state_t & vm, const fn_data_t & fd )
+// renders all the arguments (from start) in one buffer and writes it at once
+static bool col_write( vm_state_t & vm, const fn_data_t & fd, FILE * file,
+		       const bool & with_col, const bool & newline )
 {
+	std::string out, str;
 	for( size_t i = 1; i < fd.args.size(); ++i ) {
-		std::string str;
+		if( fd.args[ i ]->type() == col_tmpl_typeid ) {
+			out += COL_TMPL( fd.args[ i ] )->get().get( with_col );
+			continue;
+		}
+		str.clear();
 		if( !fd.args[ i ]->to_str( vm, str, fd.src_id, fd.idx ) ) {
-			return nullptr;
+			return false;
 		}
-		apply_colors( str );
-		fprintf( stdout, "%s", str.c_str() );
+		col_render( str, out, with_col );
 	}
-	return vm.nil;
+	if( newline ) out += '\n';
+	fwrite( out.data(), 1, out.size(), file );
+	return true;
+}
+
+var_base_t * col_print( vm_state_t & vm, const fn_data_t & fd )
+{
+	return col_write( vm, fd, stdout, stdout_col, false ) ? vm.nil : nullptr;
 }
 
 var_base_t * col_println( vm_state_t & vm, const fn_data_t & fd )
 {
-	for( size_t i = 1; i < fd.args.size(); ++i ) {
-		std::string str;
-		if( !fd.args[ i ]->to_str( vm, str, fd.src_id, fd.idx ) ) {
-			return nullptr;
-		}
-		apply_colors( str );
-		fprintf( stdout, "%s", str.c_str() );
+	return col_write( vm, fd, stdout, stdout_col, true ) ? vm.nil : nullptr;
+}
+
+var_base_t * col_dprint( vm_state_t & vm, const fn_data_t & fd )
+{
+	return col_write( vm, fd, stderr, stderr_col, false ) ? vm.nil : nullptr;
+}
+
+var_base_t * col_dprintln( vm_state_t & vm, const fn_data_t & fd )
+{
+	return col_write( vm, fd, stderr, stderr_col, true ) ? vm.nil : nullptr;
+}
+
+var_base_t * col_template( vm_state_t & vm, const fn_data_t & fd )
+{
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for template format, found: %s",
+						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
 	}
-	fprintf( stdout, "\n" );
+	return make< var_col_tmpl_t >( col_tmpl_get( STR( fd.args[ 1 ] )->get() ) );
+}
+
+var_base_t * col_template_str( vm_state_t & vm, const fn_data_t & fd )
+{
+	return make< var_str_t >( COL_TMPL( fd.args[ 0 ] )->get().get( stdout_col ) );
+}
+
+var_base_t * format( vm_state_t & vm, const fn_data_t & fd )
+{
+	std::string out;
+	if( !fmt_render( vm, fd, 1, out ) ) return nullptr;
+	return make< var_str_t >( out );
+}
+
+var_base_t * fmt_printf( vm_state_t & vm, const fn_data_t & fd )
+{
+	std::string out;
+	if( !fmt_render( vm, fd, 1, out ) ) return nullptr;
+	fwrite( out.data(), 1, out.size(), stdout );
 	return vm.nil;
 }
 
-var_base_t * col_dprint( vm_state_t & vm, const fn_data_t & fd )
+var_base_t * fmt_fprintf( vm_state_t & vm, const fn_data_t & fd )
 {
-	for( size_t i = 1; i < fd.args.size(); ++i ) {
-		std::string str;
-		if( !fd.args[ i ]->to_str( vm, str, fd.src_id, fd.idx ) ) {
-			return nullptr;
-		}
-		apply_colors( str );
-		fprintf( stderr, "%s", str.c_str() );
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_FILE ) {
+		src->fail( fd.args[ 1 ]->idx(), "expected a file argument for fprintf, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
 	}
+	if( FILE( fd.args[ 1 ] )->get() == nullptr ) {
+		src->fail( fd.args[ 1 ]->idx(), "file has probably been closed already" );
+		return nullptr;
+	}
+	std::string out;
+	if( !fmt_render( vm, fd, 2, out ) ) return nullptr;
+	fwrite( out.data(), 1, out.size(), FILE( fd.args[ 1 ] )->get() );
 	return vm.nil;
 }
 
-var_base_t * col_dprintln( vm_state_t & vm, const fn_data_t & fd )
+var_base_t * async_sink_new( vm_state_t & vm, const fn_data_t & fd )
 {
-	for( size_t i = 1; i < fd.args.size(); ++i ) {
-		std::string str;
-		if( !fd.args[ i ]->to_str( vm, str, fd.src_id, fd.idx ) ) {
-			return nullptr;
-		}
-		apply_colors( str );
-		fprintf( stderr, "%s", str.c_str() );
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_FILE ) {
+		src->fail( fd.args[ 1 ]->idx(), "expected a file argument for async sink, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( FILE( fd.args[ 1 ] )->get() == nullptr ) {
+		src->fail( fd.args[ 1 ]->idx(), "file has probably been closed already" );
+		return nullptr;
+	}
+	if( fd.args[ 2 ]->type() != VT_INT || fd.args[ 3 ]->type() != VT_INT ) {
+		src->fail( fd.idx, "expected int arguments for queue capacity and batch size, found: %s, %s",
+			   vm.type_name( fd.args[ 2 ]->type() ).c_str(), vm.type_name( fd.args[ 3 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 4 ]->type() != VT_BOOL ) {
+		src->fail( fd.idx, "expected boolean argument for block when full, found: %s",
+			   vm.type_name( fd.args[ 4 ]->type() ).c_str() );
+		return nullptr;
+	}
+	size_t capacity = INT( fd.args[ 2 ] )->get().get_ui();
+	size_t batch = INT( fd.args[ 3 ] )->get().get_ui();
+	if( capacity == 0 || batch == 0 ) {
+		src->fail( fd.idx, "queue capacity and batch size must be greater than zero" );
+		return nullptr;
 	}
-	fprintf( stderr, "\n" );
+	std::shared_ptr< async_sink_t > sink( new async_sink_t( FILE( fd.args[ 1 ] ), capacity, batch,
+								BOOL( fd.args[ 4 ] )->get() ) );
+	return make< var_async_sink_t >( sink );
+}
+
+static var_base_t * async_sink_push( vm_state_t & vm, const fn_data_t & fd, const bool & newline )
+{
+	async_sink_t & sink = ASYNC_SINK( fd.args[ 0 ] )->get();
+	if( sink.closed() ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "async sink has already been closed" );
+		return nullptr;
+	}
+	std::string rec;
+	if( !fd.args[ 1 ]->to_str( vm, rec, fd.src_id, fd.idx ) ) {
+		return nullptr;
+	}
+	if( newline ) rec += '\n';
+	return sink.push( rec ) ? vm.tru : vm.fals;
+}
+
+var_base_t * async_sink_write( vm_state_t & vm, const fn_data_t & fd )
+{
+	return async_sink_push( vm, fd, false );
+}
+
+var_base_t * async_sink_writeln( vm_state_t & vm, const fn_data_t & fd )
+{
+	return async_sink_push( vm, fd, true );
+}
+
+var_base_t * async_sink_flush( vm_state_t & vm, const fn_data_t & fd )
+{
+	ASYNC_SINK( fd.args[ 0 ] )->get().flush();
 	return vm.nil;
 }
 
+var_base_t * async_sink_close( vm_state_t & vm, const fn_data_t & fd )
+{
+	ASYNC_SINK( fd.args[ 0 ] )->get().close();
+	return vm.nil;
+}
+
+var_base_t * async_sink_depth( vm_state_t & vm, const fn_data_t & fd )
+{
+	return make< var_int_t >( ASYNC_SINK( fd.args[ 0 ] )->get().depth() );
+}
+
+var_base_t * async_sink_dropped( vm_state_t & vm, const fn_data_t & fd )
+{
+	return make< var_int_t >( ASYNC_SINK( fd.args[ 0 ] )->get().dropped() );
+}
+
 var_base_t * scan( vm_state_t & vm, const fn_data_t & fd )
 {
 	srcfile_t * src = vm.src_stack.back()->src();
@@ -150,14 +621,10 @@ var_base_t * scan( vm_state_t & vm, const fn_data_t & fd )
 		return nullptr;
 	}
 	fprintf( stdout, "%s", STR( fd.args[ 1 ] )->get().c_str() );
+	fflush( stdout );
 
-	char str[ MAX_C_STR_LEN ];
-	fgets( str, MAX_C_STR_LEN, stdin );
-	std::string res( str );
-
-	if( res.back() == '\r' ) res.pop_back();
-	if( res.back() == '\n' ) res.pop_back();
-
+	std::string res;
+	stdin_buf.read_line( res );
 	return make< var_str_t >( res );
 }
 
@@ -170,17 +637,57 @@ var_base_t * scaneof( vm_state_t & vm, const fn_data_t & fd )
 		return nullptr;
 	}
 	fprintf( stdout, "%s", STR( fd.args[ 1 ] )->get().c_str() );
+	fflush( stdout );
 
-	std::string line, res;
+	std::string res;
+	stdin_buf.read_all( res );
 
-	while( std::getline( std::cin, line ) ) res += line;
+	if( !res.empty() && res.back() == '\n' ) res.pop_back();
+	if( !res.empty() && res.back() == '\r' ) res.pop_back();
 
-	if( res.back() == '\r' ) res.pop_back();
-	if( res.back() == '\n' ) res.pop_back();
+	return make< var_str_t >( res );
+}
 
+var_base_t * stdin_read( vm_state_t & vm, const fn_data_t & fd )
+{
+	if( fd.args[ 1 ]->type() != VT_INT ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected int argument for number of bytes to read, found: %s",
+						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	const mpz_class & num = INT( fd.args[ 1 ] )->get();
+	if( sgn( num ) < 0 || !num.fits_ulong_p() ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "number of bytes to read must be a non negative integer "
+						  "that fits an unsigned long" );
+		return nullptr;
+	}
+	// nil is for the end of input only
+	if( sgn( num ) == 0 ) return make< var_str_t >( "" );
+	std::string res;
+	if( !stdin_buf.read( res, num.get_ui() ) ) return vm.nil;
 	return make< var_str_t >( res );
 }
 
+var_base_t * stdin_read_all( vm_state_t & vm, const fn_data_t & fd )
+{
+	std::string res;
+	stdin_buf.read_all( res );
+	return make< var_str_t >( res );
+}
+
+var_base_t * stdin_lines( vm_state_t & vm, const fn_data_t & fd )
+{
+	return make< var_stdin_iterable_t >();
+}
+
+var_base_t * stdin_iterable_next( vm_state_t & vm, const fn_data_t & fd )
+{
+	var_stdin_iterable_t * it = STDIN_ITERABLE( fd.args[ 0 ] );
+	var_base_t * res = nullptr;
+	if( !it->next( res ) ) return vm.nil;
+	return res;
+}
+
 var_base_t * fflush( vm_state_t & vm, const fn_data_t & fd )
 {
 	srcfile_t * src = vm.src_stack.back()->src();
@@ -202,17 +709,49 @@ INIT_MODULE( io )
 {
 	var_src_t * src = vm.src_stack.back();
 
-	src->add_nativefn( "print", print, 1, true );
-	src->add_nativefn( "println", println, 0, true );
-	src->add_nativefn( "fprint", fprint, 2, true );
-	src->add_nativefn( "fprintln", fprintln, 1, true );
-	src->add_nativefn( "cprint", col_print, 1, true );
-	src->add_nativefn( "cprintln", col_println, 0, true );
-	src->add_nativefn( "cdprint", col_dprint, 1, true );
-	src->add_nativefn( "cdprintln", col_dprintln, 0, true );
-	src->add_nativefn( "scan_native", scan, 1 );
-	src->add_nativefn( "scaneof_native", scaneof, 1 );
-	src->add_nativefn( "fflush", fflush, 1 );
+	src->add_nativefn( "print", PROF( print ), 1, true );
+	src->add_nativefn( "println", PROF( println ), 0, true );
+	src->add_nativefn( "fprint", PROF( fprint ), 2, true );
+	src->add_nativefn( "fprintln", PROF( fprintln ), 1, true );
+	src->add_nativefn( "cprint", PROF( col_print ), 1, true );
+	src->add_nativefn( "cprintln", PROF( col_println ), 0, true );
+	src->add_nativefn( "cdprint", PROF( col_dprint ), 1, true );
+	src->add_nativefn( "cdprintln", PROF( col_dprintln ), 0, true );
+	src->add_nativefn( "template", PROF( col_template ), 1 );
+	src->add_nativefn( "format", PROF( format ), 1, true );
+	src->add_nativefn( "printf", PROF( fmt_printf ), 1, true );
+	src->add_nativefn( "fprintf", PROF( fmt_fprintf ), 2, true );
+	src->add_nativefn( "async_sink_native", PROF( async_sink_new ), 4 );
+	src->add_nativefn( "scan_native", PROF( scan ), 1 );
+	src->add_nativefn( "scaneof_native", PROF( scaneof ), 1 );
+	src->add_nativefn( "read", PROF( stdin_read ), 1 );
+	src->add_nativefn( "read_all", PROF( stdin_read_all ) );
+	src->add_nativefn( "stdin_lines", PROF( stdin_lines ) );
+	src->add_nativefn( "fflush", PROF( fflush ), 1 );
+
+	// get the type id for stdin iterable (register_type)
+	stdin_iterable_typeid = vm.register_new_type( "stdin_iterable_t", src_id, idx );
+
+	vm.add_typefn_native( stdin_iterable_typeid, "next", PROF( stdin_iterable_next ), 0, src_id, idx );
+
+	// get the type id for color template (register_type)
+	col_tmpl_typeid = vm.register_new_type( "col_template_t", src_id, idx );
+
+	vm.add_typefn_native( col_tmpl_typeid, "str", PROF( col_template_str ), 0, src_id, idx );
+
+	// get the type id for async sink (register_type)
+	async_sink_typeid = vm.register_new_type( "async_sink_t", src_id, idx );
+
+	vm.add_typefn_native( async_sink_typeid,   "write", PROF( async_sink_write ),   1, src_id, idx );
+	vm.add_typefn_native( async_sink_typeid, "writeln", PROF( async_sink_writeln ), 1, src_id, idx );
+	vm.add_typefn_native( async_sink_typeid,   "flush", PROF( async_sink_flush ),   0, src_id, idx );
+	vm.add_typefn_native( async_sink_typeid,   "close", PROF( async_sink_close ),   0, src_id, idx );
+	vm.add_typefn_native( async_sink_typeid,   "depth", PROF( async_sink_depth ),   0, src_id, idx );
+	vm.add_typefn_native( async_sink_typeid, "dropped", PROF( async_sink_dropped ), 0, src_id, idx );
+
+	// no color codes when the output is redirected to a file or a pipe
+	stdout_col = isatty( STDOUT_FILENO );
+	stderr_col = isatty( STDERR_FILENO );
 
 	// stdout and stderr cannot be owned by a var_file_t
 	src->add_nativevar( "stdout", make_all< var_file_t >( stdout, "w", src_id, idx, false ) );
@@ -220,7 +759,7 @@ INIT_MODULE( io )
 	return true;
 }
 
-std::unordered_map< std::string, const char * > COL = {
+static const struct { const char * tag; const char * code; } COL[] = {
 	{ "0", "\033[0m" },
 
 	{ "r", "\033[0;31m" },
@@ -240,40 +779,301 @@ std::unordered_map< std::string, const char * > COL = {
 	{ "bw", "\033[1;37m" },
 };
 
-int apply_colors( std::string & str )
+static const char * col_code( const char * tag, const size_t & len )
 {
-	int chars = 0;
-	for( size_t i = 0; i < str.size(); ) {
-		if( str[ i ] == '{' && ( i == 0 || ( str[ i - 1 ] != '$' && str[ i - 1 ] != '%' && str[ i - 1 ] != '#' && str[ i - 1 ] != '\\' ) ) ) {
-			str.erase( str.begin() + i );
-			if( i < str.size() && str[ i ] == '{' ) {
-				++i;
-				++chars;
-				continue;
-			}
+	for( auto & col : COL ) {
+		if( strlen( col.tag ) == len && strncmp( col.tag, tag, len ) == 0 ) return col.code;
+	}
+	return nullptr;
+}
 
-			std::string var;
+// '{{' is a literal brace, '{<col>}' is replaced by the color code, unknown
+// or empty tags are removed, and a brace after '$', '%', '#' or '\' is kept as is
+col_tmpl_t::col_tmpl_t( const std::string & fmt )
+{
+	colored.reserve( fmt.size() );
+	plain.reserve( fmt.size() );
+	// last character of the colored output
+	char prev = 0;
+	for( size_t i = 0; i < fmt.size(); ) {
+		const char c = fmt[ i ];
+		if( c != '{' || prev == '$' || prev == '%' || prev == '#' || prev == '\\' ) {
+			colored += c;
+			plain += c;
+			prev = c;
+			++i;
+			continue;
+		}
+		if( i + 1 < fmt.size() && fmt[ i + 1 ] == '{' ) {
+			colored += '{';
+			plain += '{';
+			prev = '{';
+			i += 2;
+			continue;
+		}
+		size_t end = fmt.find( '}', i + 1 );
+		if( end == std::string::npos ) end = fmt.size();
+		const char * code = col_code( fmt.data() + i + 1, end - i - 1 );
+		if( code != nullptr ) {
+			colored += code;
+			prev = 'm';
+		}
+		i = end + 1;
+	}
+}
 
-			while( i < str.size() && str[ i ] != '}' ) {
-				var += str[ i ];
-				str.erase( str.begin() + i );
-			}
+std::shared_ptr< const col_tmpl_t > col_tmpl_get( const std::string & fmt )
+{
+	static std::unordered_map< std::string, std::shared_ptr< const col_tmpl_t > > cache;
+	auto it = cache.find( fmt );
+	if( it != cache.end() ) return it->second;
+	if( cache.size() >= COL_TMPL_CACHE_MAX_ENTRIES ) cache.clear();
+	std::shared_ptr< const col_tmpl_t > tmpl = std::make_shared< const col_tmpl_t >( fmt );
+	cache[ fmt ] = tmpl;
+	return tmpl;
+}
 
-			// Remove the ending brace
-			if( i < str.size() ) str.erase( str.begin() + i );
+void col_render( const std::string & str, std::string & out, const bool & with_col )
+{
+	if( memchr( str.data(), '{', str.size() ) == nullptr ) {
+		out += str;
+		return;
+	}
+	if( str.size() <= COL_TMPL_CACHE_MAX_LEN ) {
+		out += col_tmpl_get( str )->get( with_col );
+		return;
+	}
+	out += col_tmpl_t( str ).get( with_col );
+}
 
-			if( var.empty() ) continue;
+// format specification: {[index][:[[fill]align][+][0][width][.precision][type]]}
+struct fmt_spec_t
+{
+	char fill;
+	char align; // '<', '>', '^' or 0 for the type's default
+	bool plus;
+	bool zero;
+	size_t width;
+	int prec; // -1 when not given
+	char type; // 0 for the type's default
+};
+
+static bool fmt_parse_spec( const char * s, const char * end, fmt_spec_t & spec )
+{
+	spec.fill = ' ';
+	spec.align = 0;
+	spec.plus = false;
+	spec.zero = false;
+	spec.width = 0;
+	spec.prec = -1;
+	spec.type = 0;
 
-			if( COL.find( var ) != COL.end() ) {
-				std::string val = COL[ var ];
-				str.insert( str.begin() + i, val.begin(), val.end() );
-				i += val.size();
+	if( end - s >= 2 && ( s[ 1 ] == '<' || s[ 1 ] == '>' || s[ 1 ] == '^' ) ) {
+		spec.fill = s[ 0 ];
+		spec.align = s[ 1 ];
+		s += 2;
+	} else if( s < end && ( * s == '<' || * s == '>' || * s == '^' ) ) {
+		spec.align = * s++;
+	}
+	if( s < end && * s == '+' ) { spec.plus = true; ++s; }
+	if( s < end && * s == '0' ) { spec.zero = true; ++s; }
+	while( s < end && isdigit( * s ) ) spec.width = spec.width * 10 + ( * s++ - '0' );
+	if( s < end && * s == '.' ) {
+		++s;
+		if( s == end || !isdigit( * s ) ) return false;
+		spec.prec = 0;
+		while( s < end && isdigit( * s ) ) spec.prec = spec.prec * 10 + ( * s++ - '0' );
+	}
+	if( s < end ) spec.type = * s++;
+	return s == end;
+}
+
+static void fmt_pad( std::string & out, const char * data, const size_t & len,
+		     const fmt_spec_t & spec, const bool & is_num )
+{
+	if( len >= spec.width ) {
+		out.append( data, len );
+		return;
+	}
+	size_t pad = spec.width - len;
+	if( is_num && spec.zero && spec.align == 0 ) {
+		// zeros go between the sign and the digits
+		size_t sign = len > 0 && ( data[ 0 ] == '-' || data[ 0 ] == '+' );
+		out.append( data, sign );
+		out.append( pad, '0' );
+		out.append( data + sign, len - sign );
+		return;
+	}
+	char align = spec.align != 0 ? spec.align : ( is_num ? '>' : '<' );
+	size_t left = align == '>' ? pad : ( align == '^' ? pad / 2 : 0 );
+	out.append( left, spec.fill );
+	out.append( data, len );
+	out.append( pad - left, spec.fill );
+}
+
+static bool fmt_int( const mpz_class & num, const fmt_spec_t & spec, std::string & out )
+{
+	int base = 10;
+	bool upper = false;
+	switch( spec.type ) {
+	case 0: case 'd': break;
+	case 'x': base = 16; break;
+	case 'X': base = 16; upper = true; break;
+	case 'o': base = 8; break;
+	case 'b': base = 2; break;
+	default: return false;
+	}
+	char buf[ 72 ];
+	char * end = buf + sizeof( buf );
+	char * p = end;
+	if( num.fits_slong_p() ) {
+		// fast path - no GMP involved for machine sized integers
+		const long val = num.get_si();
+		unsigned long u = val < 0 ? 0UL - ( unsigned long )val : val;
+		const char * digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+		do {
+			* --p = digits[ u % base ];
+			u /= base;
+		} while( u > 0 );
+		if( val < 0 ) * --p = '-';
+		else if( spec.plus ) * --p = '+';
+		fmt_pad( out, p, end - p, spec, true );
+		return true;
+	}
+	std::string str( mpz_sizeinbase( num.get_mpz_t(), base ) + 2, 0 );
+	mpz_get_str( & str[ 0 ], upper ? -base : base, num.get_mpz_t() );
+	str.resize( strlen( str.c_str() ) );
+	if( spec.plus && num > 0 ) str.insert( str.begin(), '+' );
+	fmt_pad( out, str.data(), str.size(), spec, true );
+	return true;
+}
+
+static bool fmt_flt( mpfr_t & num, const fmt_spec_t & spec, std::string & out )
+{
+	if( spec.type != 'f' && spec.type != 'e' && spec.type != 'g' ) return false;
+	const int prec = spec.prec >= 0 ? spec.prec : 6;
+	char fmt[ 16 ];
+	// double is exact enough when the total number of significant digits stays
+	// within its precision, else MPFR does the formatting (for big values)
+	const bool use_dbl = mpfr_number_p( num ) &&
+			     ( mpfr_zero_p( num ) || ( mpfr_get_exp( num ) > -1000 && mpfr_get_exp( num ) < 1000 &&
+			       ( spec.type == 'f' ? mpfr_get_exp( num ) * 0.30103 + prec : prec ) <= 15 ) );
+	if( use_dbl ) {
+		snprintf( fmt, sizeof( fmt ), "%%%s.*%c", spec.plus ? "+" : "", spec.type );
+		char buf[ 512 ];
+		int len = snprintf( buf, sizeof( buf ), fmt, prec, mpfr_get_d( num, MPFR_RNDN ) );
+		if( len >= 0 && ( size_t )len < sizeof( buf ) ) {
+			fmt_pad( out, buf, len, spec, true );
+			return true;
+		}
+	}
+	snprintf( fmt, sizeof( fmt ), "%%%s.*R%c", spec.plus ? "+" : "", spec.type );
+	char * str = nullptr;
+	int len = mpfr_asprintf( & str, fmt, prec, num );
+	if( len < 0 ) return false;
+	fmt_pad( out, str, len, spec, true );
+	mpfr_free_str( str );
+	return true;
+}
+
+// renders fd.args[ fmt_arg ] as format, with the arguments after it as values
+bool fmt_render( vm_state_t & vm, const fn_data_t & fd, const size_t & fmt_arg, std::string & out )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ fmt_arg ]->type() != VT_STR ) {
+		src->fail( fd.args[ fmt_arg ]->idx(), "expected string argument for format, found: %s",
+			   vm.type_name( fd.args[ fmt_arg ]->type() ).c_str() );
+		return false;
+	}
+	const std::string & fmt = STR( fd.args[ fmt_arg ] )->get();
+	const size_t arg_count = fd.args.size() - fmt_arg - 1;
+	size_t next_arg = 0;
+	std::string str;
+	fmt_spec_t spec;
+
+	out.reserve( fmt.size() + arg_count * 16 );
+	for( size_t i = 0; i < fmt.size(); ) {
+		const char * lit = fmt.data() + i;
+		const char * brace = ( const char * )memchr( lit, '{', fmt.size() - i );
+		const char * cbrace = ( const char * )memchr( lit, '}', fmt.size() - i );
+		if( brace == nullptr || ( cbrace != nullptr && cbrace < brace ) ) brace = cbrace;
+		if( brace == nullptr ) {
+			out.append( lit, fmt.size() - i );
+			break;
+		}
+		out.append( lit, brace - lit );
+		i = brace - fmt.data();
+		if( i + 1 < fmt.size() && fmt[ i + 1 ] == fmt[ i ] ) {
+			out += fmt[ i ];
+			i += 2;
+			continue;
+		}
+		if( fmt[ i ] == '}' ) {
+			src->fail( fd.idx, "unmatched '}' at position %zu in format string", i );
+			return false;
+		}
+		size_t end = fmt.find( '}', i );
+		if( end == std::string::npos ) {
+			src->fail( fd.idx, "unterminated '{' at position %zu in format string", i );
+			return false;
+		}
+		size_t pos = i + 1;
+		size_t arg = next_arg;
+		if( pos < end && isdigit( fmt[ pos ] ) ) {
+			arg = 0;
+			while( pos < end && isdigit( fmt[ pos ] ) ) arg = arg * 10 + ( fmt[ pos++ ] - '0' );
+		} else {
+			++next_arg;
+		}
+		if( pos < end && fmt[ pos ] != ':' ) {
+			src->fail( fd.idx, "invalid argument index in format string at position %zu", i );
+			return false;
+		}
+		if( !fmt_parse_spec( fmt.data() + std::min( pos + 1, end ), fmt.data() + end, spec ) ) {
+			src->fail( fd.idx, "invalid format specification '%s'",
+				   fmt.substr( i, end - i + 1 ).c_str() );
+			return false;
+		}
+		if( arg >= arg_count ) {
+			src->fail( fd.idx, "format argument index %zu is out of range (argument count: %zu)",
+				   arg, arg_count );
+			return false;
+		}
+		var_base_t * val = fd.args[ fmt_arg + 1 + arg ];
+		bool ok = true;
+		if( val->type() == VT_INT && spec.type != 's' ) {
+			if( spec.type == 'f' || spec.type == 'e' || spec.type == 'g' ) {
+				mpfr_t tmp;
+				mpfr_init2( tmp, mpz_sizeinbase( INT( val )->get().get_mpz_t(), 2 ) + 1 );
+				mpfr_set_z( tmp, INT( val )->get().get_mpz_t(), MPFR_RNDN );
+				ok = fmt_flt( tmp, spec, out );
+				mpfr_clear( tmp );
+			} else {
+				ok = fmt_int( INT( val )->get(), spec, out );
 			}
+		} else if( val->type() == VT_FLT && spec.type != 's' ) {
+			if( spec.type == 0 ) {
+				// default presentation: general, or fixed when a precision is given
+				fmt_spec_t num_spec = spec;
+				num_spec.type = spec.prec >= 0 ? 'f' : 'g';
+				ok = fmt_flt( FLT( val )->get(), num_spec, out );
+			} else {
+				ok = fmt_flt( FLT( val )->get(), spec, out );
+			}
+		} else if( spec.type != 0 && spec.type != 's' ) {
+			ok = false;
+		} else {
+			str.clear();
+			if( !val->to_str( vm, str, fd.src_id, fd.idx ) ) return false;
+			if( spec.prec >= 0 && ( size_t )spec.prec < str.size() ) str.resize( spec.prec );
+			fmt_pad( out, str.data(), str.size(), spec, false );
 		}
-		else {
-			++i;
-			++chars;
+		if( !ok ) {
+			src->fail( fd.idx, "format type '%c' is not valid for argument of type: %s",
+				   spec.type, vm.type_name( val->type() ).c_str() );
+			return false;
 		}
+		i = end + 1;
 	}
-	return chars;
-}
\ No newline at end of file
+	return true;
+}
@@ -7,8 +7,135 @@
 	before using or altering the project.
 */
 
+#include <memory>
+#include <algorithm>
+
 #include <feral/VM/VM.hpp>
 
+#include "common/profile.hpp"
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////// Classes //////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// field layout of a fixed struct definition, shared by the definition, its copies and all of their instances
+// field names are resolved to slots once per definition, instances only hold the values
+struct fixed_layout_t
+{
+	int id;
+	std::vector< std::string > names; // in declaration order, the index is the slot
+	std::unordered_map< std::string, size_t > slots;
+
+	fixed_layout_t( const int & id );
+	// returns names.size() if there is no such field
+	size_t slot( const std::string & name ) const;
+};
+
+class var_fixed_struct_t : public var_base_t
+{
+	std::shared_ptr< fixed_layout_t > m_layout;
+	std::vector< var_base_t * > m_vals;
+public:
+	// takes ownership of vals (one per slot)
+	var_fixed_struct_t( const std::shared_ptr< fixed_layout_t > & layout, const std::vector< var_base_t * > & vals,
+			    const size_t & src_id, const size_t & idx );
+	~var_fixed_struct_t();
+
+	var_base_t * copy( const size_t & src_id, const size_t & idx );
+	void set( var_base_t * from );
+
+	bool attr_exists( const std::string & name );
+	// fields cannot be added to fixed structs, setting an unknown one does nothing
+	void attr_set( const std::string & name, var_base_t * val, const bool iref );
+	var_base_t * attr_get( const std::string & name );
+
+	std::vector< var_base_t * > & get();
+};
+#define FIXED_STRUCT( x ) static_cast< var_fixed_struct_t * >( x )
+
+// a struct definition (so methods can be added to it as for lang.struct) whose instances are fixed structs
+class var_fixed_struct_def_t : public var_struct_def_t
+{
+	std::shared_ptr< fixed_layout_t > m_layout;
+	// the values of attrs in slot order, per definition so that copies are independent
+	std::vector< var_base_t * > m_defaults;
+public:
+	var_fixed_struct_def_t( const std::shared_ptr< fixed_layout_t > & layout, const std::vector< std::string > & attr_order,
+				const std::unordered_map< std::string, var_base_t * > & attrs, const size_t & src_id, const size_t & idx );
+	~var_fixed_struct_def_t();
+
+	var_base_t * copy( const size_t & src_id, const size_t & idx );
+	// also updates the default of the instances created after this
+	void attr_set( const std::string & name, var_base_t * val, const bool iref );
+
+	var_base_t * call( vm_state_t & vm, const std::vector< var_base_t * > & args,
+			   const std::vector< fn_assn_arg_t > & assn_args,
+			   const std::unordered_map< std::string, size_t > & assn_args_loc,
+			   const size_t & src_id, const size_t & idx );
+};
+
+// initialize this in the init_lang function
+static int enum_typeid;
+static int enum_iterable_typeid;
+static int enum_member_struct_id;
+
+// members of an enum, immutable once built so that all copies of the enum share them
+struct enum_data_t
+{
+	std::vector< std::string > names; // in declaration order
+	std::vector< long > values;
+	// the values as ints, handed out (borrowed) as they are instead of allocating one per read,
+	// so they must never be modified in place - see lang.fer
+	std::vector< var_base_t * > vals;
+	std::unordered_map< std::string, size_t > by_name;
+	// value => first member with it, a dense table for compact values, else a map
+	long min;
+	std::vector< int > dense;
+	std::unordered_map< long, size_t > sparse;
+
+	~enum_data_t();
+	// creates the value vars and the value index
+	void build( const size_t & src_id, const size_t & idx );
+	// returns names.size() if no member has the value
+	size_t find_value( const long & value ) const;
+};
+
+class var_enum_t : public var_base_t
+{
+	std::shared_ptr< const enum_data_t > m_data;
+public:
+	var_enum_t( const std::shared_ptr< const enum_data_t > & data, const size_t & src_id, const size_t & idx );
+
+	var_base_t * copy( const size_t & src_id, const size_t & idx );
+	void set( var_base_t * from );
+
+	bool attr_exists( const std::string & name );
+	// enums are immutable, setting a member does nothing
+	void attr_set( const std::string & name, var_base_t * val, const bool iref );
+	var_base_t * attr_get( const std::string & name );
+
+	const std::shared_ptr< const enum_data_t > & get();
+};
+#define ENUM( x ) static_cast< var_enum_t * >( x )
+
+class var_enum_iterable_t : public var_base_t
+{
+	std::shared_ptr< const enum_data_t > m_data;
+	size_t m_pos;
+public:
+	var_enum_iterable_t( const std::shared_ptr< const enum_data_t > & data, const size_t & src_id, const size_t & idx );
+
+	var_base_t * copy( const size_t & src_id, const size_t & idx );
+	void set( var_base_t * from );
+
+	bool next( var_base_t * & val, const size_t & src_id, const size_t & idx );
+};
+#define ENUM_ITERABLE( x ) static_cast< var_enum_iterable_t * >( x )
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////// Functions /////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
 var_base_t * create_struct( vm_state_t & vm, const fn_data_t & fd )
 {
 	const size_t src_id = vm.src_stack.back()->src_id();
@@ -22,44 +149,359 @@ var_base_t * create_struct( vm_state_t & vm, const fn_data_t & fd )
 	return make< var_struct_def_t >( vm.register_struct_enum_id(), attr_order, attrs );
 }
 
+// same as create_struct, but instances store their fields in slots of the definition's layout
+// instead of a map per instance
+var_base_t * create_fixed_struct( vm_state_t & vm, const fn_data_t & fd )
+{
+	const size_t src_id = vm.src_stack.back()->src_id();
+	std::shared_ptr< fixed_layout_t > layout( new fixed_layout_t( vm.register_struct_enum_id() ) );
+	std::unordered_map< std::string, var_base_t * > attrs;
+	for( size_t i = 0; i < fd.assn_args.size(); ++i ) {
+		auto & arg = fd.assn_args[ i ];
+		if( layout->slots.find( arg.name ) != layout->slots.end() ) {
+			vm.src_stack.back()->src()->fail( arg.idx, "field '%s' is declared more than once", arg.name.c_str() );
+			for( auto & attr : attrs ) var_dref( attr.second );
+			return nullptr;
+		}
+		layout->slots[ arg.name ] = layout->names.size();
+		layout->names.push_back( arg.name );
+		attrs[ arg.name ] = arg.val->copy( src_id, fd.idx );
+	}
+	return make< var_fixed_struct_def_t >( layout, layout->names, attrs );
+}
+
+// positional string members get their position as value, assigned ones (name = int) their own
+// an assigned name which is also positional keeps the position with the new value
 var_base_t * create_enum( vm_state_t & vm, const fn_data_t & fd )
 {
 	srcfile_t * src_file = vm.src_stack.back()->src();
-	std::unordered_map< std::string, var_base_t * > attrs;
+	std::shared_ptr< enum_data_t > data( new enum_data_t() );
 
 	for( size_t i = 1; i < fd.args.size(); ++i ) {
 		auto & arg = fd.args[ i ];
 		if( arg->type() != VT_STR ) {
 			src_file->fail( arg->idx(), "expected const strings for enums (use strings or atoms)" );
-			goto fail;
+			return nullptr;
+		}
+		const std::string & name = STR( arg )->get();
+		auto it = data->by_name.find( name );
+		if( it != data->by_name.end() ) {
+			data->values[ it->second ] = i - 1;
+			continue;
 		}
-		attrs[ STR( arg )->get() ] = new var_int_t( i - 1, fd.src_id, fd.idx );
+		data->by_name[ name ] = data->names.size();
+		data->names.push_back( name );
+		data->values.push_back( i - 1 );
 	}
 
 	for( auto & arg : fd.assn_args ) {
 		if( arg.val->type() != VT_INT ) {
 			src_file->fail( arg.idx, "expected argument value to be of integer for enums, found: %s",
 					vm.type_name( arg.val->type() ).c_str() );
-			goto fail;
+			return nullptr;
 		}
-		if( attrs.find( arg.name ) != attrs.end() ) {
-			var_dref( attrs[ arg.name ] );
+		if( !INT( arg.val )->get().fits_slong_p() ) {
+			src_file->fail( arg.idx, "enum value for '%s' is out of range (must fit a long)", arg.name.c_str() );
+			return nullptr;
 		}
-		attrs[ arg.name ] = arg.val->copy( fd.src_id, fd.idx );
+		const long value = INT( arg.val )->get().get_si();
+		auto it = data->by_name.find( arg.name );
+		if( it != data->by_name.end() ) {
+			data->values[ it->second ] = value;
+			continue;
+		}
+		data->by_name[ arg.name ] = data->names.size();
+		data->names.push_back( arg.name );
+		data->values.push_back( value );
+	}
+
+	data->build( fd.src_id, fd.idx );
+	return make< var_enum_t >( data );
+}
+
+// name of the (first declared) member with the value, nil if there is none
+var_base_t * enum_name_of( vm_state_t & vm, const fn_data_t & fd )
+{
+	if( fd.args[ 1 ]->type() != VT_INT ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected int argument for value, found: %s",
+						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
 	}
+	const enum_data_t & data = * ENUM( fd.args[ 0 ] )->get();
+	const mpz_class & value = INT( fd.args[ 1 ] )->get();
+	if( !value.fits_slong_p() ) return vm.nil;
+	const size_t pos = data.find_value( value.get_si() );
+	if( pos >= data.names.size() ) return vm.nil;
+	return make< var_str_t >( data.names[ pos ] );
+}
 
-	return make< var_struct_t >( vm.register_struct_enum_id(), attrs );
-fail:
-	for( auto & attr : attrs ) {
-		var_dref( attr.second );
+// value of the member, nil if there is no such member
+var_base_t * enum_value_of( vm_state_t & vm, const fn_data_t & fd )
+{
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for name, found: %s",
+						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
 	}
-	return nullptr;
+	const enum_data_t & data = * ENUM( fd.args[ 0 ] )->get();
+	auto it = data.by_name.find( STR( fd.args[ 1 ] )->get() );
+	if( it == data.by_name.end() ) return vm.nil;
+	return data.vals[ it->second ];
+}
+
+var_base_t * enum_len( vm_state_t & vm, const fn_data_t & fd )
+{
+	return make< var_int_t >( ENUM( fd.args[ 0 ] )->get()->names.size() );
+}
+
+var_base_t * enum_each( vm_state_t & vm, const fn_data_t & fd )
+{
+	return make< var_enum_iterable_t >( ENUM( fd.args[ 0 ] )->get() );
+}
+
+var_base_t * enum_iterable_next( vm_state_t & vm, const fn_data_t & fd )
+{
+	var_enum_iterable_t * it = ENUM_ITERABLE( fd.args[ 0 ] );
+	var_base_t * res = nullptr;
+	if( !it->next( res, fd.src_id, fd.idx ) ) return vm.nil;
+	return res;
 }
 
 INIT_MODULE( lang )
 {
 	var_src_t * src = vm.src_stack.back();
-	src->add_nativefn( "enum", create_enum, 0, true );
-	src->add_nativefn( "struct", create_struct );
+	src->add_nativefn( "enum", PROF( create_enum ), 0, true );
+	src->add_nativefn( "struct", PROF( create_struct ) );
+	src->add_nativefn( "fixed_struct", PROF( create_fixed_struct ) );
+
+	// get the type ids for enum, enum iterable and enum iterator element (register_type)
+	enum_typeid = vm.register_new_type( "enum_t", src_id, idx );
+	enum_iterable_typeid = vm.register_new_type( "enum_iterable_t", src_id, idx );
+	enum_member_struct_id = vm.register_struct_enum_id();
+	vm.set_typename( enum_member_struct_id, "enum_member_t" );
+
+	vm.add_typefn_native( enum_typeid,  "name_of", PROF( enum_name_of ),  1, src_id, idx );
+	vm.add_typefn_native( enum_typeid, "value_of", PROF( enum_value_of ), 1, src_id, idx );
+	vm.add_typefn_native( enum_typeid,      "len", PROF( enum_len ),      0, src_id, idx );
+	vm.add_typefn_native( enum_typeid,     "each", PROF( enum_each ),     0, src_id, idx );
+	vm.add_typefn_native( enum_iterable_typeid, "next", PROF( enum_iterable_next ), 0, src_id, idx );
+	return true;
+}
+
+fixed_layout_t::fixed_layout_t( const int & id ) : id( id ) {}
+
+size_t fixed_layout_t::slot( const std::string & name ) const
+{
+	auto it = slots.find( name );
+	return it == slots.end() ? names.size() : it->second;
+}
+
+var_fixed_struct_t::var_fixed_struct_t( const std::shared_ptr< fixed_layout_t > & layout, const std::vector< var_base_t * > & vals,
+					const size_t & src_id, const size_t & idx )
+	: var_base_t( layout->id, src_id, idx, false, true ), m_layout( layout ), m_vals( vals ) {}
+var_fixed_struct_t::~var_fixed_struct_t()
+{
+	for( auto & val : m_vals ) var_dref( val );
+}
+
+var_base_t * var_fixed_struct_t::copy( const size_t & src_id, const size_t & idx )
+{
+	std::vector< var_base_t * > vals;
+	vals.reserve( m_vals.size() );
+	for( auto & val : m_vals ) vals.push_back( val->copy( src_id, idx ) );
+	return new var_fixed_struct_t( m_layout, vals, src_id, idx );
+}
+
+void var_fixed_struct_t::set( var_base_t * from )
+{
+	var_fixed_struct_t * f = FIXED_STRUCT( from );
+	for( auto & val : m_vals ) var_dref( val );
+	m_layout = f->m_layout;
+	m_vals.clear();
+	m_vals.reserve( f->m_vals.size() );
+	for( auto & val : f->m_vals ) m_vals.push_back( val->copy( src_id(), idx() ) );
+}
+
+bool var_fixed_struct_t::attr_exists( const std::string & name )
+{
+	return m_layout->slot( name ) < m_vals.size();
+}
+
+void var_fixed_struct_t::attr_set( const std::string & name, var_base_t * val, const bool iref )
+{
+	const size_t slot = m_layout->slot( name );
+	if( slot >= m_vals.size() ) return;
+	var_dref( m_vals[ slot ] );
+	if( iref ) var_iref( val );
+	m_vals[ slot ] = val;
+}
+
+var_base_t * var_fixed_struct_t::attr_get( const std::string & name )
+{
+	const size_t slot = m_layout->slot( name );
+	return slot < m_vals.size() ? m_vals[ slot ] : nullptr;
+}
+
+std::vector< var_base_t * > & var_fixed_struct_t::get() { return m_vals; }
+
+var_fixed_struct_def_t::var_fixed_struct_def_t( const std::shared_ptr< fixed_layout_t > & layout,
+						const std::vector< std::string > & attr_order,
+						const std::unordered_map< std::string, var_base_t * > & attrs,
+						const size_t & src_id, const size_t & idx )
+	: var_struct_def_t( layout->id, attr_order, attrs, src_id, idx ), m_layout( layout )
+{
+	m_defaults.reserve( layout->names.size() );
+	for( auto & name : layout->names ) m_defaults.push_back( var_iref( attrs.at( name ) ) );
+}
+var_fixed_struct_def_t::~var_fixed_struct_def_t()
+{
+	for( auto & def : m_defaults ) var_dref( def );
+}
+
+var_base_t * var_fixed_struct_def_t::copy( const size_t & src_id, const size_t & idx )
+{
+	std::unordered_map< std::string, var_base_t * > attrs;
+	for( size_t i = 0; i < m_layout->names.size(); ++i ) {
+		attrs[ m_layout->names[ i ] ] = m_defaults[ i ]->copy( src_id, idx );
+	}
+	return new var_fixed_struct_def_t( m_layout, m_layout->names, attrs, src_id, idx );
+}
+
+void var_fixed_struct_def_t::attr_set( const std::string & name, var_base_t * val, const bool iref )
+{
+	var_struct_def_t::attr_set( name, val, iref );
+	const size_t slot = m_layout->slot( name );
+	if( slot >= m_defaults.size() ) return;
+	var_dref( m_defaults[ slot ] );
+	m_defaults[ slot ] = var_iref( val );
+}
+
+// positional arguments (after args[ 0 ], the definition) fill the fields in declaration order,
+// then the assigned ones by name, the rest are copies of the defaults
+var_base_t * var_fixed_struct_def_t::call( vm_state_t & vm, const std::vector< var_base_t * > & args,
+					   const std::vector< fn_assn_arg_t > & assn_args,
+					   const std::unordered_map< std::string, size_t > & assn_args_loc,
+					   const size_t & src_id, const size_t & idx )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	const size_t count = m_layout->names.size();
+	if( args.size() > count + 1 ) {
+		src->fail( idx, "expected at most %zu positional arguments for struct, found: %zu",
+			   count, args.size() - 1 );
+		return nullptr;
+	}
+	std::vector< var_base_t * > vals( count, nullptr );
+	for( size_t i = 1; i < args.size(); ++i ) {
+		vals[ i - 1 ] = args[ i ]->copy( src_id, idx );
+	}
+	for( auto & arg : assn_args ) {
+		const size_t slot = m_layout->slot( arg.name );
+		if( slot >= count ) {
+			src->fail( arg.idx, "attribute '%s' not found in struct", arg.name.c_str() );
+			for( auto & val : vals ) {
+				if( val != nullptr ) var_dref( val );
+			}
+			return nullptr;
+		}
+		if( vals[ slot ] != nullptr ) var_dref( vals[ slot ] );
+		vals[ slot ] = arg.val->copy( src_id, idx );
+	}
+	for( size_t i = 0; i < count; ++i ) {
+		if( vals[ i ] == nullptr ) vals[ i ] = m_defaults[ i ]->copy( src_id, idx );
+	}
+	return make< var_fixed_struct_t >( m_layout, vals );
+}
+
+enum_data_t::~enum_data_t()
+{
+	for( auto & val : vals ) var_dref( val );
+}
+
+// values spanning at most this many slots per member (plus a constant) use the dense table
+const long ENUM_DENSE_SPREAD = 4;
+const long ENUM_DENSE_EXTRA = 64;
+
+void enum_data_t::build( const size_t & src_id, const size_t & idx )
+{
+	vals.reserve( values.size() );
+	for( auto & value : values ) vals.push_back( new var_int_t( value, src_id, idx ) );
+	if( values.empty() ) return;
+	min = * std::min_element( values.begin(), values.end() );
+	const long max = * std::max_element( values.begin(), values.end() );
+	// unsigned so that a span overflowing long is simply too large
+	const unsigned long span = ( unsigned long )max - ( unsigned long )min;
+	if( span < ( unsigned long )( values.size() * ENUM_DENSE_SPREAD + ENUM_DENSE_EXTRA ) ) {
+		dense.assign( span + 1, -1 );
+		for( size_t i = values.size(); i > 0; --i ) dense[ values[ i - 1 ] - min ] = i - 1;
+		return;
+	}
+	for( size_t i = values.size(); i > 0; --i ) sparse[ values[ i - 1 ] ] = i - 1;
+}
+
+size_t enum_data_t::find_value( const long & value ) const
+{
+	if( !dense.empty() ) {
+		if( value < min || ( unsigned long )value - ( unsigned long )min >= dense.size() ) return names.size();
+		const int pos = dense[ value - min ];
+		return pos < 0 ? names.size() : pos;
+	}
+	auto it = sparse.find( value );
+	return it == sparse.end() ? names.size() : it->second;
+}
+
+var_enum_t::var_enum_t( const std::shared_ptr< const enum_data_t > & data, const size_t & src_id, const size_t & idx )
+	: var_base_t( enum_typeid, src_id, idx, false, true ), m_data( data ) {}
+
+var_base_t * var_enum_t::copy( const size_t & src_id, const size_t & idx )
+{
+	return new var_enum_t( m_data, src_id, idx );
+}
+
+void var_enum_t::set( var_base_t * from )
+{
+	m_data = ENUM( from )->m_data;
+}
+
+bool var_enum_t::attr_exists( const std::string & name )
+{
+	return m_data->by_name.find( name ) != m_data->by_name.end();
+}
+
+void var_enum_t::attr_set( const std::string & name, var_base_t * val, const bool iref ) {}
+
+var_base_t * var_enum_t::attr_get( const std::string & name )
+{
+	auto it = m_data->by_name.find( name );
+	return it == m_data->by_name.end() ? nullptr : m_data->vals[ it->second ];
+}
+
+const std::shared_ptr< const enum_data_t > & var_enum_t::get() { return m_data; }
+
+var_enum_iterable_t::var_enum_iterable_t( const std::shared_ptr< const enum_data_t > & data, const size_t & src_id,
+					  const size_t & idx )
+	: var_base_t( enum_iterable_typeid, src_id, idx ), m_data( data ), m_pos( 0 ) {}
+
+var_base_t * var_enum_iterable_t::copy( const size_t & src_id, const size_t & idx )
+{
+	var_enum_iterable_t * res = new var_enum_iterable_t( m_data, src_id, idx );
+	res->m_pos = m_pos;
+	return res;
+}
+
+void var_enum_iterable_t::set( var_base_t * from )
+{
+	m_data = ENUM_ITERABLE( from )->m_data;
+	m_pos = ENUM_ITERABLE( from )->m_pos;
+}
+
+// gives enum_member_t structs, with the name as "0" and the value as "1"
+bool var_enum_iterable_t::next( var_base_t * & val, const size_t & src_id, const size_t & idx )
+{
+	if( m_pos >= m_data->names.size() ) return false;
+	std::unordered_map< std::string, var_base_t * > attrs;
+	attrs[ "0" ] = new var_str_t( m_data->names[ m_pos ], src_id, idx );
+	attrs[ "1" ] = var_iref( m_data->vals[ m_pos ] );
+	val = make< var_struct_t >( enum_member_struct_id, attrs );
+	++m_pos;
 	return true;
 }
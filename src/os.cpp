@@ -7,17 +7,660 @@
 	before using or altering the project.
 */
 
+#include <glob.h>
+#include <deque>
+#include <algorithm>
+#include <functional>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <ctime>
 #include <chrono>
 #include <thread>
+#include <condition_variable>
+#include <cerrno>
 #include <cstdlib>
+#include <fcntl.h>
+#include <dirent.h>
 #include <unistd.h>
 #include <limits.h>
+#include <poll.h>
+#include <spawn.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
 #include <sys/wait.h>
+#include <sys/syscall.h>
+#if __linux__
+#include <sys/sendfile.h>
+#endif
 
 #include <feral/VM/VM.hpp>
 
-int exec_internal( const std::string & file );
+#include "common/profile.hpp"
+#include "common/stat.hpp"
+
+#if defined( __GLIBC__ ) && ( __GLIBC__ > 2 || ( __GLIBC__ == 2 && __GLIBC_MINOR__ >= 29 ) )
+#define SPAWN_HAS_ADDCHDIR 1
+#else
+#define SPAWN_HAS_ADDCHDIR 0
+#endif
+
+// directories with at least this many files have them copied by a pool of threads
+const size_t COPY_PARALLEL_MIN_FILES = 16;
+// how often a process is checked for having ended when that cannot be polled for (no pidfd)
+const int PROC_REAP_POLL_MS = 10;
+
 std::string dir_part( const std::string & full_loc );
+std::string base_part( const std::string & full_loc );
+std::vector< std::string > glob_expand( const std::string & pattern );
+bool mode_apply( const std::string & spec, const mode_t & mode, const bool & is_dir, mode_t & res );
+int mkdir_p( const std::string & path, const mode_t & mode );
+
+// the paths for which a file operation failed, with the errno (added to from the copy threads as well)
+struct path_errs_t
+{
+	std::mutex mtx;
+	std::vector< std::pair< std::string, int > > errs;
+	void add( const std::string & path, const int & err );
+};
+// the result of the file operations
+static var_base_t * path_errs_vec( path_errs_t & errs, const size_t & src_id, const size_t & idx );
+
+// these return false if any path failed, which are then in errs
+bool copy_tree( const std::string & src, const std::string & dest, const bool & remove_dest, path_errs_t & errs );
+bool move_tree( const std::string & src, const std::string & dest, path_errs_t & errs );
+bool rm_tree( const std::string & path, path_errs_t & errs );
+bool chmod_tree( const std::string & path, const std::string & mode, const bool & recurse, path_errs_t & errs );
+
+// a child process started by proc_spawn, with the parent ends of its pipes
+struct proc_t
+{
+	pid_t pid;
+	int pidfd;  // -1 where pidfd_open is not available
+	int in_fd;  // the pipes are -1 when not piped, or once closed
+	int out_fd;
+	int err_fd;
+	std::string input;
+	size_t input_off;
+	std::string out;
+	std::string err;
+	int status;
+	bool reaped;
+	bool done;
+	bool timed_out;
+	int64_t start_ns;
+	int64_t end_ns;
+};
+
+// returns 0 on success, else the errno
+// env is the complete environment (KEY=value) when custom_env is set, else the current one is inherited
+// without capture, the child writes to the stdout/stderr of the interpreter
+// stdin of the child is a pipe fed with proc.input when has_input is set, else inherited
+int proc_spawn( proc_t & proc, const std::vector< std::string > & argv, const std::vector< std::string > & env,
+		const bool & custom_env, const std::string & cwd, const bool & capture, const bool & has_input );
+void proc_reset( proc_t & proc );
+// appends the descriptors to wait on for the process to make progress
+// returns the longest the wait may take in ms (-1 for no limit)
+int proc_pollfds( const proc_t & proc, std::vector< struct pollfd > & fds );
+// feeds the input, reads the available output and reaps the process if it ended - never blocks
+void proc_service( proc_t & proc );
+// kills the process (if it is still running) and reaps it, dropping any further output
+void proc_kill( proc_t & proc );
+// environment of the interpreter with the overrides applied
+std::vector< std::string > env_merge( const std::unordered_map< std::string, std::string > & overrides );
+int64_t mono_ns();
+// sleeps until the deadline on the monotonic clock (mono_ns)
+void sleep_until_ns( const int64_t & deadline );
+
+struct mem_info_t;
+// fills in the memory and descriptor usage of the process
+void mem_read( mem_info_t & mem );
+
+// initialize these in the init_os function
+static int proc_result_struct_id;
+static int rusage_struct_id;
+static int mem_struct_id;
+static int mem_sample_struct_id;
+static int path_error_struct_id;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+///////////////////////////////////////////////////////////// Classes //////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+
+// index of the names in the PATH directories, valid as long as PATH and
+// the modification times of the directories stay the same
+class path_index_t
+{
+	std::string m_path;
+	std::vector< std::string > m_dirs;
+	std::vector< int64_t > m_mtimes;
+	// name -> indices of the dirs containing it, in PATH order
+	std::unordered_map< std::string, std::vector< size_t > > m_names;
+
+	static int64_t dir_mtime( const std::string & dir );
+	bool valid( const std::string & path );
+	void build( const std::string & path );
+public:
+	// full path of the first executable named name in PATH, empty if there is none
+	std::string find( const std::string & name );
+	// all the executables named name in PATH
+	std::vector< std::string > find_all( const std::string & name );
+};
+static path_index_t path_index;
+
+int64_t path_index_t::dir_mtime( const std::string & dir )
+{
+	struct stat st;
+	if( stat( dir.c_str(), & st ) != 0 ) return -1;
+	return mtime_ns( st );
+}
+
+bool path_index_t::valid( const std::string & path )
+{
+	if( path != m_path || m_mtimes.size() != m_dirs.size() ) return false;
+	for( size_t i = 0; i < m_dirs.size(); ++i ) {
+		if( dir_mtime( m_dirs[ i ] ) != m_mtimes[ i ] ) return false;
+	}
+	return true;
+}
+
+void path_index_t::build( const std::string & path )
+{
+	m_path = path;
+	m_dirs.clear();
+	m_mtimes.clear();
+	m_names.clear();
+	for( size_t beg = 0; beg <= path.size(); ) {
+		size_t end = path.find( ':', beg );
+		if( end == std::string::npos ) end = path.size();
+		// an empty entry means the current directory
+		m_dirs.push_back( end > beg ? path.substr( beg, end - beg ) : "." );
+		beg = end + 1;
+	}
+	for( size_t i = 0; i < m_dirs.size(); ++i ) {
+		m_mtimes.push_back( dir_mtime( m_dirs[ i ] ) );
+		DIR * dir = opendir( m_dirs[ i ].c_str() );
+		if( dir == nullptr ) continue;
+		struct dirent * ent;
+		while( ( ent = readdir( dir ) ) != nullptr ) {
+			if( ent->d_type == DT_DIR ) continue;
+			std::vector< size_t > & dirs = m_names[ ent->d_name ];
+			if( dirs.empty() || dirs.back() != i ) dirs.push_back( i );
+		}
+		closedir( dir );
+	}
+}
+
+// regular file (or link to one) with the executable bit for the user
+static bool is_exec( const std::string & file )
+{
+	struct stat st;
+	return stat( file.c_str(), & st ) == 0 && S_ISREG( st.st_mode ) && access( file.c_str(), X_OK ) == 0;
+}
+
+std::string path_index_t::find( const std::string & name )
+{
+	std::vector< std::string > all = find_all( name );
+	return all.empty() ? "" : all.front();
+}
+
+std::vector< std::string > path_index_t::find_all( const std::string & name )
+{
+	std::vector< std::string > res;
+	if( name.empty() ) return res;
+	if( name.find( '/' ) != std::string::npos ) {
+		if( is_exec( name ) ) res.push_back( name );
+		return res;
+	}
+	const char * path = getenv( "PATH" );
+	const std::string path_str = path == nullptr ? "" : path;
+	if( !valid( path_str ) ) build( path_str );
+	auto it = m_names.find( name );
+	if( it == m_names.end() ) return res;
+	// the index only has names, the permissions are checked on the candidates
+	for( auto & d : it->second ) {
+		std::string file = m_dirs[ d ] + "/" + name;
+		if( is_exec( file ) ) res.push_back( file );
+	}
+	return res;
+}
+
+// memory and descriptor usage of the process, -1 where not available
+struct mem_info_t
+{
+	int64_t rss;
+	int64_t hwm;
+	int64_t fds;
+};
+
+struct mem_sample_t
+{
+	int64_t time_ns;
+	mem_info_t mem;
+	int64_t user_ns;
+	int64_t sys_ns;
+};
+
+// records samples of the process' usage every interval on a background thread,
+// keeping the latest capacity ones in a ring buffer
+class mem_sampler_t
+{
+	std::vector< mem_sample_t > m_ring;
+	size_t m_next;
+	size_t m_count;
+	int64_t m_interval_ns;
+	bool m_stop;
+	std::mutex m_mtx;
+	std::condition_variable m_cv;
+	std::thread m_thread;
+
+	void run();
+public:
+	mem_sampler_t( const int64_t & interval_ns, const size_t & capacity );
+	~mem_sampler_t();
+
+	void stop();
+	void clear();
+	// the samples in the buffer, oldest first
+	std::vector< mem_sample_t > samples();
+};
+
+mem_sampler_t::mem_sampler_t( const int64_t & interval_ns, const size_t & capacity )
+	: m_ring( std::max( capacity, ( size_t )1 ) ), m_next( 0 ), m_count( 0 ), m_interval_ns( interval_ns ),
+	  m_stop( false ), m_thread( & mem_sampler_t::run, this ) {}
+
+mem_sampler_t::~mem_sampler_t() { stop(); }
+
+void mem_sampler_t::run()
+{
+	int64_t deadline = mono_ns();
+	std::unique_lock< std::mutex > lock( m_mtx );
+	while( !m_stop ) {
+		lock.unlock();
+		mem_sample_t sample;
+		sample.time_ns = mono_ns();
+		mem_read( sample.mem );
+		struct rusage ru;
+		getrusage( RUSAGE_SELF, & ru );
+		sample.user_ns = ( int64_t )ru.ru_utime.tv_sec * 1000000000 + ru.ru_utime.tv_usec * 1000;
+		sample.sys_ns = ( int64_t )ru.ru_stime.tv_sec * 1000000000 + ru.ru_stime.tv_usec * 1000;
+		lock.lock();
+		m_ring[ m_next ] = sample;
+		m_next = ( m_next + 1 ) % m_ring.size();
+		if( m_count < m_ring.size() ) ++m_count;
+		// fixed schedule, so the sampling itself does not make the interval drift
+		deadline += m_interval_ns;
+		const int64_t wait = deadline - mono_ns();
+		if( wait > 0 ) m_cv.wait_for( lock, std::chrono::nanoseconds( wait ), [ this ]() { return m_stop; } );
+		else deadline = mono_ns();
+	}
+}
+
+void mem_sampler_t::stop()
+{
+	{
+		std::lock_guard< std::mutex > lock( m_mtx );
+		m_stop = true;
+	}
+	m_cv.notify_all();
+	if( m_thread.joinable() ) m_thread.join();
+}
+
+void mem_sampler_t::clear()
+{
+	std::lock_guard< std::mutex > lock( m_mtx );
+	m_next = m_count = 0;
+}
+
+std::vector< mem_sample_t > mem_sampler_t::samples()
+{
+	std::lock_guard< std::mutex > lock( m_mtx );
+	std::vector< mem_sample_t > res;
+	res.reserve( m_count );
+	const size_t first = ( m_next + m_ring.size() - m_count ) % m_ring.size();
+	for( size_t i = 0; i < m_count; ++i ) res.push_back( m_ring[ ( first + i ) % m_ring.size() ] );
+	return res;
+}
+
+// initialize this in the init_os function
+static int mem_sampler_typeid;
+
+class var_mem_sampler_t : public var_base_t
+{
+	std::shared_ptr< mem_sampler_t > m_sampler;
+public:
+	var_mem_sampler_t( const std::shared_ptr< mem_sampler_t > & sampler, const size_t & src_id, const size_t & idx );
+
+	var_base_t * copy( const size_t & src_id, const size_t & idx );
+	void set( var_base_t * from );
+
+	std::shared_ptr< mem_sampler_t > & get();
+};
+#define MEM_SAMPLER( x ) static_cast< var_mem_sampler_t * >( x )
+
+var_mem_sampler_t::var_mem_sampler_t( const std::shared_ptr< mem_sampler_t > & sampler, const size_t & src_id,
+				      const size_t & idx )
+	: var_base_t( mem_sampler_typeid, src_id, idx ), m_sampler( sampler ) {}
+
+var_base_t * var_mem_sampler_t::copy( const size_t & src_id, const size_t & idx )
+{
+	return new var_mem_sampler_t( m_sampler, src_id, idx );
+}
+void var_mem_sampler_t::set( var_base_t * from )
+{
+	m_sampler = MEM_SAMPLER( from )->m_sampler;
+}
+
+std::shared_ptr< mem_sampler_t > & var_mem_sampler_t::get() { return m_sampler; }
+
+// initialize this in the init_os function
+static int stopwatch_typeid;
+
+// monotonic stopwatch - elapsed time since start / reset, lap time since the previous lap
+class var_stopwatch_t : public var_base_t
+{
+	int64_t m_start;
+	int64_t m_lap;
+public:
+	var_stopwatch_t( const size_t & src_id, const size_t & idx );
+
+	var_base_t * copy( const size_t & src_id, const size_t & idx );
+	void set( var_base_t * from );
+
+	void reset();
+	int64_t elapsed();
+	int64_t lap();
+};
+#define STOPWATCH( x ) static_cast< var_stopwatch_t * >( x )
+
+var_stopwatch_t::var_stopwatch_t( const size_t & src_id, const size_t & idx )
+	: var_base_t( stopwatch_typeid, src_id, idx ) { reset(); }
+
+var_base_t * var_stopwatch_t::copy( const size_t & src_id, const size_t & idx )
+{
+	var_stopwatch_t * sw = new var_stopwatch_t( src_id, idx );
+	sw->m_start = m_start;
+	sw->m_lap = m_lap;
+	return sw;
+}
+void var_stopwatch_t::set( var_base_t * from )
+{
+	m_start = STOPWATCH( from )->m_start;
+	m_lap = STOPWATCH( from )->m_lap;
+}
+
+void var_stopwatch_t::reset() { m_start = m_lap = mono_ns(); }
+int64_t var_stopwatch_t::elapsed() { return mono_ns() - m_start; }
+int64_t var_stopwatch_t::lap()
+{
+	const int64_t now = mono_ns();
+	const int64_t res = now - m_lap;
+	m_lap = now;
+	return res;
+}
+
+enum JobState {
+	JOB_QUEUED,
+	JOB_RUNNING,
+	JOB_DONE,
+};
+
+// a job of a process pool - waits in the queue until the pool has a free slot
+// cancelled jobs which never started finish with code -1, jobs which failed to spawn with 127
+struct pool_job_t
+{
+	size_t id;
+	int state;
+	std::vector< std::string > argv;
+	std::vector< std::string > env;
+	bool custom_env;
+	bool has_input;
+	std::string cwd;
+	long timeout;
+	bool capture;
+	proc_t proc;
+	// built once the job is done, owned by the job
+	var_base_t * result;
+
+	pool_job_t();
+	~pool_job_t();
+	bool failed();
+};
+
+pool_job_t::pool_job_t() : id( 0 ), state( JOB_QUEUED ), result( nullptr ) { proc_reset( proc ); }
+pool_job_t::~pool_job_t()
+{
+	proc_kill( proc );
+	if( result != nullptr ) var_dref( result );
+}
+
+bool pool_job_t::failed()
+{
+	return !proc.reaped || proc.timed_out || !WIFEXITED( proc.status ) || WEXITSTATUS( proc.status ) != 0;
+}
+
+// runs up to max_jobs processes at a time, driven by poll on their pipes and pidfds
+// with fail_fast, the first job which fails cancels all the queued and running ones
+class proc_pool_t
+{
+	size_t m_max_jobs;
+	bool m_fail_fast;
+	size_t m_next_id;
+	std::deque< std::shared_ptr< pool_job_t > > m_queue;
+	std::vector< std::shared_ptr< pool_job_t > > m_running;
+	// done, but not returned by wait_any yet
+	std::deque< std::shared_ptr< pool_job_t > > m_finished;
+	// submitted since the last wait_all
+	std::vector< std::shared_ptr< pool_job_t > > m_submitted;
+
+	void start_queued();
+	void finish( const std::shared_ptr< pool_job_t > & job );
+public:
+	proc_pool_t( const size_t & max_jobs, const bool & fail_fast );
+
+	void submit( const std::shared_ptr< pool_job_t > & job );
+	// waits until at least one running job makes progress, or timeout_ms (if not negative)
+	// returns false if there is nothing left to run
+	bool step( const int & timeout_ms );
+	void cancel();
+
+	// returns the next finished job not yet returned, nullptr once all are
+	std::shared_ptr< pool_job_t > wait_any();
+	void wait( const std::shared_ptr< pool_job_t > & job );
+	// runs all jobs to completion, returns the ones submitted since the last call in order
+	std::vector< std::shared_ptr< pool_job_t > > wait_all();
+
+	size_t running();
+	size_t queued();
+};
+
+proc_pool_t::proc_pool_t( const size_t & max_jobs, const bool & fail_fast )
+	: m_max_jobs( max_jobs ), m_fail_fast( fail_fast ), m_next_id( 0 ) {}
+
+void proc_pool_t::start_queued()
+{
+	while( !m_queue.empty() && m_running.size() < m_max_jobs ) {
+		std::shared_ptr< pool_job_t > job = m_queue.front();
+		m_queue.pop_front();
+		int err = proc_spawn( job->proc, job->argv, job->env, job->custom_env, job->cwd, job->capture, job->has_input );
+		if( err != 0 ) {
+			job->proc.err = "failed to spawn '" + job->argv[ 0 ] + "': " + strerror( err );
+			job->proc.status = 127 << 8;
+			job->proc.reaped = job->proc.done = true;
+			finish( job );
+			continue;
+		}
+		job->state = JOB_RUNNING;
+		m_running.push_back( job );
+	}
+}
+
+void proc_pool_t::finish( const std::shared_ptr< pool_job_t > & job )
+{
+	job->state = JOB_DONE;
+	m_finished.push_back( job );
+	if( m_fail_fast && job->failed() ) cancel();
+}
+
+void proc_pool_t::submit( const std::shared_ptr< pool_job_t > & job )
+{
+	job->id = m_next_id++;
+	m_queue.push_back( job );
+	m_submitted.push_back( job );
+	start_queued();
+}
+
+bool proc_pool_t::step( const int & timeout_ms )
+{
+	start_queued();
+	if( m_running.empty() ) return false;
+	std::vector< struct pollfd > fds;
+	int wait = timeout_ms;
+	const int64_t now = mono_ns();
+	for( auto & job : m_running ) {
+		int job_wait = proc_pollfds( job->proc, fds );
+		if( job->timeout >= 0 ) {
+			const int64_t left = job->proc.start_ns + ( int64_t )job->timeout * 1000000 - now;
+			const int left_ms = left > 0 ? ( left + 999999 ) / 1000000 : 0;
+			if( job_wait < 0 || left_ms < job_wait ) job_wait = left_ms;
+		}
+		if( job_wait >= 0 && ( wait < 0 || job_wait < wait ) ) wait = job_wait;
+	}
+	if( poll( fds.data(), fds.size(), wait ) < 0 && errno != EINTR ) return true;
+	const int64_t after = mono_ns();
+	for( size_t i = 0; i < m_running.size(); ) {
+		std::shared_ptr< pool_job_t > job = m_running[ i ];
+		if( job->timeout >= 0 && after >= job->proc.start_ns + ( int64_t )job->timeout * 1000000 ) {
+			proc_kill( job->proc );
+			job->proc.timed_out = true;
+		} else {
+			proc_service( job->proc );
+		}
+		if( !job->proc.done ) {
+			++i;
+			continue;
+		}
+		m_running.erase( m_running.begin() + i );
+		finish( job );
+	}
+	start_queued();
+	return true;
+}
+
+void proc_pool_t::cancel()
+{
+	std::deque< std::shared_ptr< pool_job_t > > queue;
+	queue.swap( m_queue );
+	std::vector< std::shared_ptr< pool_job_t > > running;
+	running.swap( m_running );
+	for( auto & job : queue ) {
+		job->proc.done = true;
+		job->state = JOB_DONE;
+		m_finished.push_back( job );
+	}
+	for( auto & job : running ) {
+		proc_kill( job->proc );
+		job->state = JOB_DONE;
+		m_finished.push_back( job );
+	}
+}
+
+std::shared_ptr< pool_job_t > proc_pool_t::wait_any()
+{
+	while( m_finished.empty() ) {
+		if( !step( -1 ) ) return nullptr;
+	}
+	std::shared_ptr< pool_job_t > job = m_finished.front();
+	m_finished.pop_front();
+	return job;
+}
+
+void proc_pool_t::wait( const std::shared_ptr< pool_job_t > & job )
+{
+	while( job->state != JOB_DONE && step( -1 ) );
+}
+
+std::vector< std::shared_ptr< pool_job_t > > proc_pool_t::wait_all()
+{
+	while( step( -1 ) );
+	m_finished.clear();
+	std::vector< std::shared_ptr< pool_job_t > > res;
+	res.swap( m_submitted );
+	return res;
+}
+
+size_t proc_pool_t::running() { return m_running.size(); }
+size_t proc_pool_t::queued() { return m_queue.size(); }
+
+// initialize these in the init_os function
+static int proc_pool_typeid;
+static int pool_job_typeid;
+
+class var_proc_pool_t : public var_base_t
+{
+	std::shared_ptr< proc_pool_t > m_pool;
+public:
+	var_proc_pool_t( const std::shared_ptr< proc_pool_t > & pool, const size_t & src_id, const size_t & idx );
+
+	var_base_t * copy( const size_t & src_id, const size_t & idx );
+	void set( var_base_t * from );
+
+	std::shared_ptr< proc_pool_t > & get();
+};
+#define PROC_POOL( x ) static_cast< var_proc_pool_t * >( x )
+
+var_proc_pool_t::var_proc_pool_t( const std::shared_ptr< proc_pool_t > & pool, const size_t & src_id, const size_t & idx )
+	: var_base_t( proc_pool_typeid, src_id, idx ), m_pool( pool ) {}
+
+var_base_t * var_proc_pool_t::copy( const size_t & src_id, const size_t & idx )
+{
+	return new var_proc_pool_t( m_pool, src_id, idx );
+}
+void var_proc_pool_t::set( var_base_t * from )
+{
+	m_pool = PROC_POOL( from )->m_pool;
+}
+
+std::shared_ptr< proc_pool_t > & var_proc_pool_t::get() { return m_pool; }
+
+// future of a job - keeps the pool alive to be able to drive it while waiting
+class var_pool_job_t : public var_base_t
+{
+	std::shared_ptr< proc_pool_t > m_pool;
+	std::shared_ptr< pool_job_t > m_job;
+public:
+	var_pool_job_t( const std::shared_ptr< proc_pool_t > & pool, const std::shared_ptr< pool_job_t > & job,
+			const size_t & src_id, const size_t & idx );
+
+	var_base_t * copy( const size_t & src_id, const size_t & idx );
+	void set( var_base_t * from );
+
+	std::shared_ptr< proc_pool_t > & pool();
+	std::shared_ptr< pool_job_t > & job();
+};
+#define POOL_JOB( x ) static_cast< var_pool_job_t * >( x )
+
+var_pool_job_t::var_pool_job_t( const std::shared_ptr< proc_pool_t > & pool, const std::shared_ptr< pool_job_t > & job,
+				const size_t & src_id, const size_t & idx )
+	: var_base_t( pool_job_typeid, src_id, idx ), m_pool( pool ), m_job( job ) {}
+
+var_base_t * var_pool_job_t::copy( const size_t & src_id, const size_t & idx )
+{
+	return new var_pool_job_t( m_pool, m_job, src_id, idx );
+}
+void var_pool_job_t::set( var_base_t * from )
+{
+	m_pool = POOL_JOB( from )->m_pool;
+	m_job = POOL_JOB( from )->m_job;
+}
+
+std::shared_ptr< proc_pool_t > & var_pool_job_t::pool() { return m_pool; }
+std::shared_ptr< pool_job_t > & var_pool_job_t::job() { return m_job; }
+
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
+//////////////////////////////////////////////////////////// Functions /////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 
 var_base_t * sleep_custom( vm_state_t & vm, const fn_data_t & fd )
 {
@@ -64,64 +707,483 @@ var_base_t * set_env( vm_state_t & vm, const fn_data_t & fd )
 	std::string var = STR( fd.args[ 1 ] )->get();
 	std::string val = STR( fd.args[ 2 ] )->get();
 
-	bool overwrite = BOOL( fd.args[ 3 ] )->get();
-	return make< var_int_t >( setenv( var.c_str(), val.c_str(), overwrite ) );
+	bool overwrite = BOOL( fd.args[ 3 ] )->get();
+	return make< var_int_t >( setenv( var.c_str(), val.c_str(), overwrite ) );
+}
+
+var_base_t * exec_custom( vm_state_t & vm, const fn_data_t & fd )
+{
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for command, found: %s",
+						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	std::string cmd = STR( fd.args[ 1 ] )->get();
+
+	FILE * pipe = popen( cmd.c_str(), "r" );
+	if( !pipe ) return make< var_int_t >( 1 );
+	char * line = NULL;
+	size_t len = 0;
+	ssize_t nread;
+
+	while( ( nread = getline( & line, & len, pipe ) ) != -1 ) {
+		fprintf( stdout, "%s", line );
+	}
+	free( line );
+	int res = pclose( pipe );
+
+	res = WEXITSTATUS( res );
+	return make< var_int_t >( res );
+}
+
+var_base_t * install( vm_state_t & vm, const fn_data_t & fd )
+{
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for source, found: %s",
+						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 2 ]->type() != VT_STR ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for destination, found: %s",
+						  vm.type_name( fd.args[ 2 ]->type() ).c_str() );
+		return nullptr;
+	}
+	std::string src = STR( fd.args[ 1 ] )->get(),
+		    dest = STR( fd.args[ 2 ] )->get();
+
+	if( src.empty() || dest.empty() ) {
+		return make< var_vec_t >( std::vector< var_base_t * >() );
+	}
+
+	path_errs_t errs;
+	int err = mkdir_p( dest, 0777 );
+	if( err != 0 ) {
+		errs.add( dest, err );
+		return path_errs_vec( errs, fd.src_id, fd.idx );
+	}
+	for( auto & path : glob_expand( src ) ) {
+		copy_tree( path, dest + "/" + base_part( path ), true, errs );
+	}
+	return path_errs_vec( errs, fd.src_id, fd.idx );
+}
+
+// fields of the proc_result_t struct for a finished process
+static std::unordered_map< std::string, var_base_t * > proc_result_attrs( proc_t & proc, const size_t & src_id,
+									  const size_t & idx )
+{
+	std::unordered_map< std::string, var_base_t * > attrs;
+	const bool exited = proc.reaped && WIFEXITED( proc.status );
+	attrs[ "code" ] = new var_int_t( exited ? WEXITSTATUS( proc.status ) : -1, src_id, idx );
+	attrs[ "signal" ] = new var_int_t( proc.reaped && WIFSIGNALED( proc.status ) ? WTERMSIG( proc.status ) : 0, src_id, idx );
+	attrs[ "out" ] = new var_str_t( "", src_id, idx );
+	STR( attrs[ "out" ] )->get().swap( proc.out );
+	attrs[ "err" ] = new var_str_t( "", src_id, idx );
+	STR( attrs[ "err" ] )->get().swap( proc.err );
+	attrs[ "timed_out" ] = new var_bool_t( proc.timed_out, src_id, idx );
+	attrs[ "duration_ns" ] = new var_int_t( ( long )( proc.end_ns - proc.start_ns ), src_id, idx );
+	return attrs;
+}
+
+// collects argv (arg 1), input (2, nil or string), env overrides (3, nil or map) and cwd (4) for spawning
+static bool spawn_args( vm_state_t & vm, const fn_data_t & fd, std::vector< std::string > & argv,
+			std::vector< std::string > & env, bool & custom_env, bool & has_input, std::string & input )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_VEC || VEC( fd.args[ 1 ] )->get().empty() ) {
+		src->fail( fd.idx, "expected non empty vector argument for argv, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return false;
+	}
+	for( auto & arg : VEC( fd.args[ 1 ] )->get() ) {
+		if( arg->type() != VT_STR ) {
+			src->fail( fd.idx, "expected vector of strings for argv, found element: %s",
+				   vm.type_name( arg->type() ).c_str() );
+			return false;
+		}
+		argv.push_back( STR( arg )->get() );
+	}
+	has_input = fd.args[ 2 ]->type() == VT_STR;
+	if( !has_input && fd.args[ 2 ]->type() != VT_NIL ) {
+		src->fail( fd.idx, "expected string or nil argument for input, found: %s",
+			   vm.type_name( fd.args[ 2 ]->type() ).c_str() );
+		return false;
+	}
+	if( has_input ) input = STR( fd.args[ 2 ] )->get();
+	custom_env = fd.args[ 3 ]->type() == VT_MAP;
+	if( !custom_env && fd.args[ 3 ]->type() != VT_NIL ) {
+		src->fail( fd.idx, "expected map or nil argument for env, found: %s",
+			   vm.type_name( fd.args[ 3 ]->type() ).c_str() );
+		return false;
+	}
+	if( custom_env ) {
+		std::unordered_map< std::string, std::string > overrides;
+		for( auto & e : MAP( fd.args[ 3 ] )->get() ) {
+			if( e.second->type() != VT_STR ) {
+				src->fail( fd.idx, "expected string values in env, found: %s for '%s'",
+					   vm.type_name( e.second->type() ).c_str(), e.first.c_str() );
+				return false;
+			}
+			overrides[ e.first ] = STR( e.second )->get();
+		}
+		env = env_merge( overrides );
+	}
+	if( fd.args[ 4 ]->type() != VT_STR ) {
+		src->fail( fd.idx, "expected string argument for cwd, found: %s",
+			   vm.type_name( fd.args[ 4 ]->type() ).c_str() );
+		return false;
+	}
+	return true;
+}
+
+// runs argv directly (no shell) and waits for it, up to timeout ms if it is not negative
+// returns a proc_result_t struct (code, signal, out, err, timed_out, duration_ns)
+var_base_t * os_spawn( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	std::vector< std::string > argv, env;
+	bool custom_env, has_input;
+	std::string input;
+	if( !spawn_args( vm, fd, argv, env, custom_env, has_input, input ) ) return nullptr;
+	if( fd.args[ 5 ]->type() != VT_INT ) {
+		src->fail( fd.idx, "expected int argument for timeout, found: %s",
+			   vm.type_name( fd.args[ 5 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 6 ]->type() != VT_BOOL ) {
+		src->fail( fd.idx, "expected boolean argument for capture, found: %s",
+			   vm.type_name( fd.args[ 6 ]->type() ).c_str() );
+		return nullptr;
+	}
+	const long timeout = INT( fd.args[ 5 ] )->get().get_si();
+
+	proc_t proc;
+	proc.input.swap( input );
+	int err = proc_spawn( proc, argv, env, custom_env, STR( fd.args[ 4 ] )->get(), BOOL( fd.args[ 6 ] )->get(), has_input );
+	if( err != 0 ) {
+		src->fail( fd.idx, "failed to spawn '%s': %s", argv[ 0 ].c_str(), strerror( err ) );
+		return nullptr;
+	}
+	const int64_t deadline = proc.start_ns + ( int64_t )timeout * 1000000;
+	std::vector< struct pollfd > fds;
+	while( !proc.done ) {
+		fds.clear();
+		int wait = proc_pollfds( proc, fds );
+		if( timeout >= 0 ) {
+			const int64_t left = deadline - mono_ns();
+			if( left <= 0 ) {
+				proc_kill( proc );
+				proc.timed_out = true;
+				break;
+			}
+			const int left_ms = ( left + 999999 ) / 1000000;
+			if( wait < 0 || left_ms < wait ) wait = left_ms;
+		}
+		if( poll( fds.data(), fds.size(), wait ) < 0 && errno != EINTR ) {
+			proc_kill( proc );
+			break;
+		}
+		proc_service( proc );
+	}
+	return make< var_struct_t >( proc_result_struct_id, proc_result_attrs( proc, fd.src_id, fd.idx ) );
+}
+
+// result struct of a finished job, built once and owned by the job
+static var_base_t * job_result( pool_job_t & job, const size_t & src_id, const size_t & idx )
+{
+	if( job.result == nullptr ) {
+		job.result = new var_struct_t( proc_result_struct_id, proc_result_attrs( job.proc, src_id, idx ), src_id, idx );
+	}
+	return job.result;
+}
+
+var_base_t * os_pool( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_INT ) {
+		src->fail( fd.idx, "expected int argument for max jobs, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 2 ]->type() != VT_BOOL ) {
+		src->fail( fd.idx, "expected boolean argument for fail fast, found: %s",
+			   vm.type_name( fd.args[ 2 ]->type() ).c_str() );
+		return nullptr;
+	}
+	long max_jobs = INT( fd.args[ 1 ] )->get().get_si();
+	if( max_jobs <= 0 ) max_jobs = std::max( std::thread::hardware_concurrency(), 1U );
+	std::shared_ptr< proc_pool_t > pool( new proc_pool_t( max_jobs, BOOL( fd.args[ 2 ] )->get() ) );
+	return make< var_proc_pool_t >( pool );
+}
+
+// same arguments as spawn, returns the job
+var_base_t * pool_submit( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	std::shared_ptr< pool_job_t > job( new pool_job_t() );
+	if( !spawn_args( vm, fd, job->argv, job->env, job->custom_env, job->has_input, job->proc.input ) ) return nullptr;
+	if( fd.args[ 5 ]->type() != VT_INT ) {
+		src->fail( fd.idx, "expected int argument for timeout, found: %s",
+			   vm.type_name( fd.args[ 5 ]->type() ).c_str() );
+		return nullptr;
+	}
+	if( fd.args[ 6 ]->type() != VT_BOOL ) {
+		src->fail( fd.idx, "expected boolean argument for capture, found: %s",
+			   vm.type_name( fd.args[ 6 ]->type() ).c_str() );
+		return nullptr;
+	}
+	job->cwd = STR( fd.args[ 4 ] )->get();
+	job->timeout = INT( fd.args[ 5 ] )->get().get_si();
+	job->capture = BOOL( fd.args[ 6 ] )->get();
+	std::shared_ptr< proc_pool_t > & pool = PROC_POOL( fd.args[ 0 ] )->get();
+	pool->submit( job );
+	return make< var_pool_job_t >( pool, job );
+}
+
+// next finished job (in order of completion), nil once all have been returned
+var_base_t * pool_wait_any( vm_state_t & vm, const fn_data_t & fd )
+{
+	std::shared_ptr< proc_pool_t > & pool = PROC_POOL( fd.args[ 0 ] )->get();
+	std::shared_ptr< pool_job_t > job = pool->wait_any();
+	if( !job ) return vm.nil;
+	return make< var_pool_job_t >( pool, job );
+}
+
+// results of all the jobs submitted since the last wait_all, in order of submission
+var_base_t * pool_wait_all( vm_state_t & vm, const fn_data_t & fd )
+{
+	std::vector< std::shared_ptr< pool_job_t > > jobs = PROC_POOL( fd.args[ 0 ] )->get()->wait_all();
+	std::vector< var_base_t * > res;
+	res.reserve( jobs.size() );
+	for( auto & job : jobs ) {
+		var_base_t * result = job_result( * job, fd.src_id, fd.idx );
+		var_iref( result );
+		res.push_back( result );
+	}
+	return make< var_vec_t >( res );
+}
+
+var_base_t * pool_cancel( vm_state_t & vm, const fn_data_t & fd )
+{
+	PROC_POOL( fd.args[ 0 ] )->get()->cancel();
+	return vm.nil;
+}
+
+var_base_t * pool_running( vm_state_t & vm, const fn_data_t & fd )
+{
+	return make< var_int_t >( PROC_POOL( fd.args[ 0 ] )->get()->running() );
+}
+
+var_base_t * pool_queued( vm_state_t & vm, const fn_data_t & fd )
+{
+	return make< var_int_t >( PROC_POOL( fd.args[ 0 ] )->get()->queued() );
+}
+
+var_base_t * pool_job_wait( vm_state_t & vm, const fn_data_t & fd )
+{
+	var_pool_job_t * job = POOL_JOB( fd.args[ 0 ] );
+	job->pool()->wait( job->job() );
+	return job_result( * job->job(), fd.src_id, fd.idx );
+}
+
+// makes whatever progress is possible without blocking, then tells if the job is done
+var_base_t * pool_job_done( vm_state_t & vm, const fn_data_t & fd )
+{
+	var_pool_job_t * job = POOL_JOB( fd.args[ 0 ] );
+	if( job->job()->state != JOB_DONE ) job->pool()->step( 0 );
+	return job->job()->state == JOB_DONE ? vm.tru : vm.fals;
+}
+
+var_base_t * pool_job_id( vm_state_t & vm, const fn_data_t & fd )
+{
+	return make< var_int_t >( POOL_JOB( fd.args[ 0 ] )->job()->id );
+}
+
+// monotonic clock in ns - the time base of sleep_until and the stopwatch
+var_base_t * os_now_ns( vm_state_t & vm, const fn_data_t & fd )
+{
+	return make< var_int_t >( ( long )mono_ns() );
+}
+
+// wall clock (since the epoch) in ns
+var_base_t * os_wall_ns( vm_state_t & vm, const fn_data_t & fd )
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_REALTIME, & ts );
+	return make< var_int_t >( ( long )ts.tv_sec * 1000000000 + ts.tv_nsec );
+}
+
+var_base_t * os_sleep_ns( vm_state_t & vm, const fn_data_t & fd )
+{
+	if( fd.args[ 1 ]->type() != VT_INT ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected integer argument for sleep time, found: %s",
+						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	// as a deadline, so that interruptions do not stretch the sleep
+	sleep_until_ns( mono_ns() + INT( fd.args[ 1 ] )->get().get_si() );
+	return vm.nil;
+}
+
+// sleeps until the deadline, in the time base of now_ns - periodic loops
+// which advance the deadline by their period do not drift
+var_base_t * os_sleep_until( vm_state_t & vm, const fn_data_t & fd )
+{
+	if( fd.args[ 1 ]->type() != VT_INT ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected integer argument for deadline, found: %s",
+						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	sleep_until_ns( INT( fd.args[ 1 ] )->get().get_si() );
+	return vm.nil;
+}
+
+var_base_t * os_stopwatch( vm_state_t & vm, const fn_data_t & fd )
+{
+	return make< var_stopwatch_t >();
+}
+
+var_base_t * stopwatch_elapsed( vm_state_t & vm, const fn_data_t & fd )
+{
+	return make< var_int_t >( ( long )STOPWATCH( fd.args[ 0 ] )->elapsed() );
+}
+
+var_base_t * stopwatch_lap( vm_state_t & vm, const fn_data_t & fd )
+{
+	return make< var_int_t >( ( long )STOPWATCH( fd.args[ 0 ] )->lap() );
+}
+
+var_base_t * stopwatch_reset( vm_state_t & vm, const fn_data_t & fd )
+{
+	STOPWATCH( fd.args[ 0 ] )->reset();
+	return fd.args[ 0 ];
 }
 
-var_base_t * exec_custom( vm_state_t & vm, const fn_data_t & fd )
+// cpu time, peak rss, page faults and context switches of the process (or its waited for children)
+var_base_t * os_rusage( vm_state_t & vm, const fn_data_t & fd )
 {
-	if( fd.args[ 1 ]->type() != VT_STR ) {
-		vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for command, found: %s",
+	if( fd.args[ 1 ]->type() != VT_BOOL ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "expected boolean argument for children, found: %s",
 						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
 		return nullptr;
 	}
-	std::string cmd = STR( fd.args[ 1 ] )->get();
+	struct rusage ru;
+	getrusage( BOOL( fd.args[ 1 ] )->get() ? RUSAGE_CHILDREN : RUSAGE_SELF, & ru );
+#if __APPLE__
+	const long max_rss = ru.ru_maxrss;
+#else
+	const long max_rss = ru.ru_maxrss * 1024;
+#endif
+	std::unordered_map< std::string, var_base_t * > attrs;
+	attrs[ "user_ns" ] = new var_int_t( ( long )ru.ru_utime.tv_sec * 1000000000 + ru.ru_utime.tv_usec * 1000, fd.src_id, fd.idx );
+	attrs[ "sys_ns" ] = new var_int_t( ( long )ru.ru_stime.tv_sec * 1000000000 + ru.ru_stime.tv_usec * 1000, fd.src_id, fd.idx );
+	attrs[ "max_rss" ] = new var_int_t( max_rss, fd.src_id, fd.idx );
+	attrs[ "minor_faults" ] = new var_int_t( ru.ru_minflt, fd.src_id, fd.idx );
+	attrs[ "major_faults" ] = new var_int_t( ru.ru_majflt, fd.src_id, fd.idx );
+	attrs[ "vol_ctx_switches" ] = new var_int_t( ru.ru_nvcsw, fd.src_id, fd.idx );
+	attrs[ "invol_ctx_switches" ] = new var_int_t( ru.ru_nivcsw, fd.src_id, fd.idx );
+	return make< var_struct_t >( rusage_struct_id, attrs );
+}
 
-	FILE * pipe = popen( cmd.c_str(), "r" );
-	if( !pipe ) return make< var_int_t >( 1 );
-	char * line = NULL;
-	size_t len = 0;
-	ssize_t nread;
+static std::unordered_map< std::string, var_base_t * > mem_attrs( const mem_info_t & mem, const size_t & src_id,
+								   const size_t & idx )
+{
+	std::unordered_map< std::string, var_base_t * > attrs;
+	attrs[ "rss" ] = new var_int_t( ( long )mem.rss, src_id, idx );
+	attrs[ "hwm" ] = new var_int_t( ( long )mem.hwm, src_id, idx );
+	attrs[ "fds" ] = new var_int_t( ( long )mem.fds, src_id, idx );
+	return attrs;
+}
 
-	while( ( nread = getline( & line, & len, pipe ) ) != -1 ) {
-		fprintf( stdout, "%s", line );
+// current and peak resident memory in bytes, and the number of open file descriptors
+var_base_t * os_mem( vm_state_t & vm, const fn_data_t & fd )
+{
+	mem_info_t mem;
+	mem_read( mem );
+	return make< var_struct_t >( mem_struct_id, mem_attrs( mem, fd.src_id, fd.idx ) );
+}
+
+var_base_t * os_sampler( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_INT || INT( fd.args[ 1 ] )->get() <= 0 ) {
+		src->fail( fd.idx, "expected positive int argument for interval, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
 	}
-	free( line );
-	int res = pclose( pipe );
+	if( fd.args[ 2 ]->type() != VT_INT || INT( fd.args[ 2 ] )->get() <= 0 ) {
+		src->fail( fd.idx, "expected positive int argument for capacity, found: %s",
+			   vm.type_name( fd.args[ 2 ]->type() ).c_str() );
+		return nullptr;
+	}
+	std::shared_ptr< mem_sampler_t > sampler( new mem_sampler_t( ( int64_t )INT( fd.args[ 1 ] )->get().get_si() * 1000000,
+								     INT( fd.args[ 2 ] )->get().get_ui() ) );
+	return make< var_mem_sampler_t >( sampler );
+}
 
-	res = WEXITSTATUS( res );
-	return make< var_int_t >( res );
+// vector of mem_sample_t structs (time_ns, rss, hwm, fds, user_ns, sys_ns), oldest first
+var_base_t * sampler_samples( vm_state_t & vm, const fn_data_t & fd )
+{
+	std::vector< mem_sample_t > samples = MEM_SAMPLER( fd.args[ 0 ] )->get()->samples();
+	std::vector< var_base_t * > res;
+	res.reserve( samples.size() );
+	for( auto & s : samples ) {
+		std::unordered_map< std::string, var_base_t * > attrs = mem_attrs( s.mem, fd.src_id, fd.idx );
+		attrs[ "time_ns" ] = new var_int_t( ( long )s.time_ns, fd.src_id, fd.idx );
+		attrs[ "user_ns" ] = new var_int_t( ( long )s.user_ns, fd.src_id, fd.idx );
+		attrs[ "sys_ns" ] = new var_int_t( ( long )s.sys_ns, fd.src_id, fd.idx );
+		res.push_back( new var_struct_t( mem_sample_struct_id, attrs, fd.src_id, fd.idx ) );
+	}
+	return make< var_vec_t >( res );
 }
 
-var_base_t * install( vm_state_t & vm, const fn_data_t & fd )
+var_base_t * sampler_clear( vm_state_t & vm, const fn_data_t & fd )
+{
+	MEM_SAMPLER( fd.args[ 0 ] )->get()->clear();
+	return vm.nil;
+}
+
+var_base_t * sampler_stop( vm_state_t & vm, const fn_data_t & fd )
+{
+	MEM_SAMPLER( fd.args[ 0 ] )->get()->stop();
+	return vm.nil;
+}
+
+// full path of the executable in PATH, empty string if it is not found
+var_base_t * os_find_exec( vm_state_t & vm, const fn_data_t & fd )
 {
 	if( fd.args[ 1 ]->type() != VT_STR ) {
-		vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for source, found: %s",
+		vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for executable name, found: %s",
 						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
 		return nullptr;
 	}
-	if( fd.args[ 2 ]->type() != VT_STR ) {
-		vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for destination, found: %s",
-						  vm.type_name( fd.args[ 2 ]->type() ).c_str() );
+	return make< var_str_t >( path_index.find( STR( fd.args[ 1 ] )->get() ) );
+}
+
+// for each name in the vector, a vector of all the matching executables in PATH order
+var_base_t * os_which_all( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_VEC ) {
+		src->fail( fd.idx, "expected vector argument for executable names, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
 		return nullptr;
 	}
-	std::string src = STR( fd.args[ 1 ] )->get(),
-		    dest = STR( fd.args[ 2 ] )->get();
-
-	if( src.empty() || dest.empty() ) {
-		return make< var_int_t >( 0 );
+	for( auto & e : VEC( fd.args[ 1 ] )->get() ) {
+		if( e->type() != VT_STR ) {
+			src->fail( fd.idx, "expected vector of strings for executable names, found element: %s",
+				   vm.type_name( e->type() ).c_str() );
+			return nullptr;
+		}
 	}
-
-	if( exec_internal( "mkdir -p " + dest ) != 0 ) {
-		return make< var_int_t >( -1 );
+	std::vector< var_base_t * > res;
+	for( auto & e : VEC( fd.args[ 1 ] )->get() ) {
+		std::vector< var_base_t * > paths;
+		for( auto & path : path_index.find_all( STR( e )->get() ) ) {
+			paths.push_back( new var_str_t( path, fd.src_id, fd.idx ) );
+		}
+		res.push_back( new var_vec_t( paths, fd.src_id, fd.idx ) );
 	}
-	std::string cmd_str;
-#if __linux__ || __ANDROID__
-	cmd_str = "cp -r --remove-destination " + src + " " + dest;
-#elif __APPLE__ || __FreeBSD__ || __NetBSD__ || __OpenBSD__ || __bsdi__ || __DragonFly__
-	cmd_str = "cp -rf " + src + " " + dest;
-#endif
-	return make< var_int_t >( exec_internal( cmd_str ) );
+	return make< var_vec_t >( res );
 }
 
 var_base_t * os_get_name( vm_state_t & vm, const fn_data_t & fd )
@@ -170,19 +1232,21 @@ var_base_t * os_mkdir( vm_state_t & vm, const fn_data_t & fd )
 						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
 		return nullptr;
 	}
-	std::string dest = STR( fd.args[ 1 ] )->get();
-
 	for( size_t i = 2; i < fd.args.size(); ++i ) {
 		if( fd.args[ i ]->type() != VT_STR ) {
 			vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for destination directory, found: %s",
 							  vm.type_name( fd.args[ i ]->type() ).c_str() );
 			return nullptr;
 		}
-		std::string tmpdest = STR( fd.args[ i ] )->get();
-		if( tmpdest.empty() ) continue;
-		dest += " " + tmpdest;
 	}
-	return make< var_int_t >( exec_internal( "mkdir -p " + dest ) );
+	path_errs_t errs;
+	for( size_t i = 1; i < fd.args.size(); ++i ) {
+		const std::string & dest = STR( fd.args[ i ] )->get();
+		if( dest.empty() ) continue;
+		int err = mkdir_p( dest, 0777 );
+		if( err != 0 ) errs.add( dest, err );
+	}
+	return path_errs_vec( errs, fd.src_id, fd.idx );
 }
 
 var_base_t * os_rm( vm_state_t & vm, const fn_data_t & fd )
@@ -192,54 +1256,81 @@ var_base_t * os_rm( vm_state_t & vm, const fn_data_t & fd )
 						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
 		return nullptr;
 	}
-	std::string dest = STR( fd.args[ 1 ] )->get();
-
 	for( size_t i = 2; i < fd.args.size(); ++i ) {
 		if( fd.args[ i ]->type() != VT_STR ) {
 			vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for destination directory, found: %s",
 							  vm.type_name( fd.args[ i ]->type() ).c_str() );
 			return nullptr;
 		}
-		std::string tmpdest = STR( fd.args[ i ] )->get();
-		if( tmpdest.empty() ) continue;
-		dest += " " + tmpdest;
 	}
-	if( dest.empty() ) {
-		return make< var_int_t >( 0 );
+	path_errs_t errs;
+	for( size_t i = 1; i < fd.args.size(); ++i ) {
+		const std::string & dest = STR( fd.args[ i ] )->get();
+		if( dest.empty() ) continue;
+		for( auto & path : glob_expand( dest ) ) rm_tree( path, errs );
 	}
-	return make< var_int_t >( exec_internal( "rm -r " + dest ) );
+	return path_errs_vec( errs, fd.src_id, fd.idx );
 }
 
-var_base_t * os_copy( vm_state_t & vm, const fn_data_t & fd )
+// collects the (glob expanded) sources and the destination for copy and move
+// sources are all the arguments except the last one, which is the destination
+static bool collect_src_dest( vm_state_t & vm, const fn_data_t & fd, std::vector< std::string > & srcs )
 {
-	if( fd.args[ 1 ]->type() != VT_STR ) {
-		vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for source, found: %s",
-						  vm.type_name( fd.args[ 1 ]->type() ).c_str() );
-		return nullptr;
-	}
-
-	std::string src = STR( fd.args[ 1 ] )->get();
-	// last element is the destination
-	for( size_t i = 2; i < fd.args.size() - 1; ++i ) {
+	for( size_t i = 1; i < fd.args.size(); ++i ) {
 		if( fd.args[ i ]->type() != VT_STR ) {
-			vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for destination directory, found: %s",
+			vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for %s, found: %s",
+							  i < fd.args.size() - 1 ? "source" : "destination",
 							  vm.type_name( fd.args[ i ]->type() ).c_str() );
-			return nullptr;
+			return false;
 		}
-		std::string tmpdest = STR( fd.args[ i ] )->get();
-		if( tmpdest.empty() ) continue;
-		src += " " + tmpdest;
 	}
+	for( size_t i = 1; i < fd.args.size() - 1; ++i ) {
+		const std::string & src = STR( fd.args[ i ] )->get();
+		if( src.empty() ) continue;
+		std::vector< std::string > paths = glob_expand( src );
+		srcs.insert( srcs.end(), paths.begin(), paths.end() );
+	}
+	return true;
+}
 
-	if( fd.args[ fd.args.size() - 1 ]->type() != VT_STR ) {
-		vm.src_stack.back()->src()->fail( fd.idx, "expected string argument for source, found: %s",
-						  vm.type_name( fd.args[ fd.args.size() - 1 ]->type() ).c_str() );
-		return nullptr;
+// like cp -r / mv: into the destination if it is a directory, else as the destination
+static void transfer( const std::vector< std::string > & srcs, const std::string & dest, path_errs_t & errs,
+		      bool ( * fn )( const std::string & src, const std::string & dest, path_errs_t & errs ) )
+{
+	struct stat st;
+	bool dest_is_dir = stat( dest.c_str(), & st ) == 0 && S_ISDIR( st.st_mode );
+	if( srcs.size() > 1 && !dest_is_dir ) {
+		errs.add( dest, ENOTDIR );
+		return;
 	}
+	for( auto & src : srcs ) {
+		fn( src, dest_is_dir ? dest + "/" + base_part( src ) : dest, errs );
+	}
+}
+
+static bool copy_tree_plain( const std::string & src, const std::string & dest, path_errs_t & errs )
+{
+	return copy_tree( src, dest, false, errs );
+}
 
+var_base_t * os_copy( vm_state_t & vm, const fn_data_t & fd )
+{
+	std::vector< std::string > srcs;
+	if( !collect_src_dest( vm, fd, srcs ) ) return nullptr;
 	const std::string & dest = STR( fd.args[ fd.args.size() - 1 ] )->get();
+	path_errs_t errs;
+	transfer( srcs, dest, errs, copy_tree_plain );
+	return path_errs_vec( errs, fd.src_id, fd.idx );
+}
 
-	return make< var_int_t >( exec_internal( "cp -r " + src + " " + dest ) );
+var_base_t * os_move( vm_state_t & vm, const fn_data_t & fd )
+{
+	std::vector< std::string > srcs;
+	if( !collect_src_dest( vm, fd, srcs ) ) return nullptr;
+	const std::string & dest = STR( fd.args[ fd.args.size() - 1 ] )->get();
+	path_errs_t errs;
+	transfer( srcs, dest, errs, move_tree );
+	return path_errs_vec( errs, fd.src_id, fd.idx );
 }
 
 var_base_t * os_chmod( vm_state_t & vm, const fn_data_t & fd )
@@ -262,51 +1353,100 @@ var_base_t * os_chmod( vm_state_t & vm, const fn_data_t & fd )
 	const std::string & dest = STR( fd.args[ 1 ] )->get();
 	const std::string & mode = STR( fd.args[ 2 ] )->get();
 	const bool & recurse = BOOL( fd.args[ 3 ] )->get();
-	std::string cmd = "chmod ";
-	if( recurse ) cmd += "-R ";
-	cmd += mode + " " + dest;
-	return make< var_int_t >( exec_internal( cmd ) );
+	mode_t tmp;
+	if( !mode_apply( mode, 0, false, tmp ) ) {
+		vm.src_stack.back()->src()->fail( fd.idx, "invalid mode '%s' for chmod", mode.c_str() );
+		return nullptr;
+	}
+	path_errs_t errs;
+	for( auto & path : glob_expand( dest ) ) chmod_tree( path, mode, recurse, errs );
+	return path_errs_vec( errs, fd.src_id, fd.idx );
 }
 
 INIT_MODULE( os )
 {
 	var_src_t * src = vm.src_stack.back();
 
-	src->add_nativefn( "sleep", sleep_custom, 1 );
+	src->add_nativefn( "sleep", PROF( sleep_custom ), 1 );
+	src->add_nativefn( "sleep_ns", PROF( os_sleep_ns ), 1 );
+	src->add_nativefn( "sleep_until", PROF( os_sleep_until ), 1 );
+	src->add_nativefn( "now_ns", PROF( os_now_ns ) );
+	src->add_nativefn( "wall_ns", PROF( os_wall_ns ) );
+	src->add_nativefn( "stopwatch", PROF( os_stopwatch ) );
 
-	src->add_nativefn( "get_env", get_env, 1 );
-	src->add_nativefn( "set_env_native", set_env, 3 );
+	// get the type id for stopwatch (register_type)
+	stopwatch_typeid = vm.register_new_type( "stopwatch_t", src_id, idx );
 
-	src->add_nativefn( "exec", exec_custom, 1 );
-	src->add_nativefn( "install", install, 2 );
+	vm.add_typefn_native( stopwatch_typeid, "elapsed", PROF( stopwatch_elapsed ), 0, src_id, idx );
+	vm.add_typefn_native( stopwatch_typeid,     "lap", PROF( stopwatch_lap ),     0, src_id, idx );
+	vm.add_typefn_native( stopwatch_typeid,   "reset", PROF( stopwatch_reset ),   0, src_id, idx );
 
-	src->add_nativefn( "os_get_name_native", os_get_name );
+	src->add_nativefn( "rusage_native", PROF( os_rusage ), 1 );
+	src->add_nativefn( "mem", PROF( os_mem ) );
+	src->add_nativefn( "sampler_native", PROF( os_sampler ), 2 );
 
-	src->add_nativefn( "get_cwd", os_get_cwd );
-	src->add_nativefn( "set_cwd", os_set_cwd, 1 );
+	// get the struct ids for the usage records, and the type id for sampler (register_type)
+	rusage_struct_id = vm.register_struct_enum_id();
+	vm.set_typename( rusage_struct_id, "rusage_t" );
+	mem_struct_id = vm.register_struct_enum_id();
+	vm.set_typename( mem_struct_id, "mem_t" );
+	mem_sample_struct_id = vm.register_struct_enum_id();
+	vm.set_typename( mem_sample_struct_id, "mem_sample_t" );
+	mem_sampler_typeid = vm.register_new_type( "mem_sampler_t", src_id, idx );
 
-	src->add_nativefn( "mkdir", os_mkdir, 1, true );
-	src->add_nativefn( "rm", os_rm, 1, true );
+	vm.add_typefn_native( mem_sampler_typeid, "samples", PROF( sampler_samples ), 0, src_id, idx );
+	vm.add_typefn_native( mem_sampler_typeid,   "clear", PROF( sampler_clear ),   0, src_id, idx );
+	vm.add_typefn_native( mem_sampler_typeid,    "stop", PROF( sampler_stop ),    0, src_id, idx );
 
-	src->add_nativefn( "copy", os_copy, 2, true );
+	src->add_nativefn( "get_env", PROF( get_env ), 1 );
+	src->add_nativefn( "set_env_native", PROF( set_env ), 3 );
 
-	src->add_nativefn( "chmod_native", os_chmod, 3 );
+	src->add_nativefn( "exec", PROF( exec_custom ), 1 );
+	src->add_nativefn( "install", PROF( install ), 2 );
+	src->add_nativefn( "spawn_native", PROF( os_spawn ), 6 );
 
-	return true;
-}
+	// get the struct id for the results of processes
+	proc_result_struct_id = vm.register_struct_enum_id();
+	vm.set_typename( proc_result_struct_id, "proc_result_t" );
 
-int exec_internal( const std::string & cmd )
-{
-	FILE * pipe = popen( cmd.c_str(), "r" );
-	if( !pipe ) return 1;
-	char * line = NULL;
-	size_t len = 0;
-	ssize_t nread;
+	src->add_nativefn( "pool_native", PROF( os_pool ), 2 );
 
-	while( ( nread = getline( & line, & len, pipe ) ) != -1 );
-	free( line );
-	int res = pclose( pipe );
-	return WEXITSTATUS( res );
+	// get the type ids for process pool and its jobs (register_type)
+	proc_pool_typeid = vm.register_new_type( "proc_pool_t", src_id, idx );
+	pool_job_typeid = vm.register_new_type( "pool_job_t", src_id, idx );
+
+	vm.add_typefn_native( proc_pool_typeid, "submit_native", PROF( pool_submit ),   6, src_id, idx );
+	vm.add_typefn_native( proc_pool_typeid,      "wait_any", PROF( pool_wait_any ), 0, src_id, idx );
+	vm.add_typefn_native( proc_pool_typeid,      "wait_all", PROF( pool_wait_all ), 0, src_id, idx );
+	vm.add_typefn_native( proc_pool_typeid,        "cancel", PROF( pool_cancel ),   0, src_id, idx );
+	vm.add_typefn_native( proc_pool_typeid,       "running", PROF( pool_running ),  0, src_id, idx );
+	vm.add_typefn_native( proc_pool_typeid,        "queued", PROF( pool_queued ),   0, src_id, idx );
+
+	vm.add_typefn_native( pool_job_typeid, "wait", PROF( pool_job_wait ), 0, src_id, idx );
+	vm.add_typefn_native( pool_job_typeid, "done", PROF( pool_job_done ), 0, src_id, idx );
+	vm.add_typefn_native( pool_job_typeid,   "id", PROF( pool_job_id ),   0, src_id, idx );
+
+	src->add_nativefn( "os_get_name_native", PROF( os_get_name ) );
+
+	src->add_nativefn( "find_exec", PROF( os_find_exec ), 1 );
+	src->add_nativefn( "which_all", PROF( os_which_all ), 1 );
+
+	src->add_nativefn( "get_cwd", PROF( os_get_cwd ) );
+	src->add_nativefn( "set_cwd", PROF( os_set_cwd ), 1 );
+
+	// get the struct id for the failures of the file operations
+	path_error_struct_id = vm.register_struct_enum_id();
+	vm.set_typename( path_error_struct_id, "path_error_t" );
+
+	src->add_nativefn( "mkdir", PROF( os_mkdir ), 1, true );
+	src->add_nativefn( "rm", PROF( os_rm ), 1, true );
+
+	src->add_nativefn( "copy", PROF( os_copy ), 2, true );
+	src->add_nativefn( "move", PROF( os_move ), 2, true );
+
+	src->add_nativefn( "chmod_native", PROF( os_chmod ), 3 );
+
+	return true;
 }
 
 std::string dir_part( const std::string & full_loc )
@@ -315,4 +1455,596 @@ std::string dir_part( const std::string & full_loc )
 	if( loc == std::string::npos ) return ".";
 	if( loc == 0 ) return "/";
 	return full_loc.substr( 0, loc );
-}
\ No newline at end of file
+}
+
+std::string base_part( const std::string & full_loc )
+{
+	size_t end = full_loc.find_last_not_of( '/' );
+	if( end == std::string::npos ) return full_loc.empty() ? "" : "/";
+	size_t loc = full_loc.find_last_of( '/', end );
+	if( loc == std::string::npos ) return full_loc.substr( 0, end + 1 );
+	return full_loc.substr( loc + 1, end - loc );
+}
+
+// expands the pattern like the shell would, an unmatched pattern is used as is
+std::vector< std::string > glob_expand( const std::string & pattern )
+{
+	std::vector< std::string > res;
+	if( pattern.find_first_of( "*?[" ) == std::string::npos ) {
+		res.push_back( pattern );
+		return res;
+	}
+	glob_t g;
+	if( glob( pattern.c_str(), 0, nullptr, & g ) == 0 ) {
+		res.assign( g.gl_pathv, g.gl_pathv + g.gl_pathc );
+	} else {
+		res.push_back( pattern );
+	}
+	globfree( & g );
+	return res;
+}
+
+// applies an octal (0755) or symbolic (u+x,go-w) mode spec on the given mode
+bool mode_apply( const std::string & spec, const mode_t & mode, const bool & is_dir, mode_t & res )
+{
+	if( spec.empty() ) return false;
+	if( spec.find_first_not_of( "01234567" ) == std::string::npos ) {
+		res = strtoul( spec.c_str(), nullptr, 8 ) & 07777;
+		return true;
+	}
+	res = mode;
+	size_t i = 0;
+	while( i < spec.size() ) {
+		mode_t who = 0;
+		for( ; i < spec.size() && strchr( "ugoa", spec[ i ] ); ++i ) {
+			switch( spec[ i ] ) {
+			case 'u': who |= S_ISUID | S_IRWXU; break;
+			case 'g': who |= S_ISGID | S_IRWXG; break;
+			case 'o': who |= S_ISVTX | S_IRWXO; break;
+			case 'a': who |= 07777; break;
+			}
+		}
+		if( who == 0 ) who = 07777;
+		if( i == spec.size() || !strchr( "+-=", spec[ i ] ) ) return false;
+		while( i < spec.size() && strchr( "+-=", spec[ i ] ) ) {
+			const char op = spec[ i++ ];
+			mode_t bits = 0;
+			for( ; i < spec.size() && strchr( "rwxXst", spec[ i ] ); ++i ) {
+				switch( spec[ i ] ) {
+				case 'r': bits |= 0444; break;
+				case 'w': bits |= 0222; break;
+				case 'x': bits |= 0111; break;
+				case 'X': if( is_dir || ( mode & 0111 ) ) bits |= 0111; break;
+				case 's': bits |= S_ISUID | S_ISGID; break;
+				case 't': bits |= S_ISVTX; break;
+				}
+			}
+			bits &= who;
+			if( op == '+' ) res |= bits;
+			else if( op == '-' ) res &= ~bits;
+			else res = ( res & ~who ) | bits;
+		}
+		if( i < spec.size() && spec[ i++ ] != ',' ) return false;
+	}
+	return true;
+}
+
+// returns 0 on success, else the errno
+int mkdir_p( const std::string & path, const mode_t & mode )
+{
+	for( size_t pos = path.find( '/', 1 ); ; pos = path.find( '/', pos + 1 ) ) {
+		const std::string part = path.substr( 0, pos );
+		if( part.back() != '/' && mkdir( part.c_str(), mode ) != 0 && errno != EEXIST ) return errno;
+		if( pos == std::string::npos ) break;
+	}
+	struct stat st;
+	if( stat( path.c_str(), & st ) != 0 ) return errno;
+	return S_ISDIR( st.st_mode ) ? 0 : ENOTDIR;
+}
+
+// copies the contents of in to out, in kernel where possible
+// returns 0 on success, else the errno
+static int copy_fd( const int & in, const int & out, const off_t & size )
+{
+	off_t done = 0;
+#if __linux__
+#if defined( __GLIBC__ ) && ( __GLIBC__ > 2 || ( __GLIBC__ == 2 && __GLIBC_MINOR__ >= 27 ) )
+	// can reflink or do server side copies depending on the file system
+	while( done < size ) {
+		ssize_t res = copy_file_range( in, nullptr, out, nullptr, size - done, 0 );
+		if( res < 0 && errno == EINTR ) continue;
+		if( res <= 0 ) break;
+		done += res;
+	}
+#endif
+	while( done < size ) {
+		ssize_t res = sendfile( out, in, nullptr, size - done );
+		if( res < 0 && errno == EINTR ) continue;
+		if( res <= 0 ) break;
+		done += res;
+	}
+	if( done >= size && size > 0 ) return 0;
+#endif
+	// whatever is left (or all of it) - both offsets are where the above stopped
+	std::vector< char > buf( 128 * 1024 );
+	while( true ) {
+		ssize_t len = read( in, buf.data(), buf.size() );
+		if( len < 0 && errno == EINTR ) continue;
+		if( len < 0 ) return errno;
+		if( len == 0 ) break;
+		for( ssize_t off = 0; off < len; ) {
+			ssize_t res = write( out, buf.data() + off, len - off );
+			if( res < 0 && errno == EINTR ) continue;
+			if( res < 0 ) return errno;
+			off += res;
+		}
+	}
+	return 0;
+}
+
+// copies a single non directory entry, returns 0 on success, else the errno
+static int copy_entry( const std::string & src, const std::string & dest, const struct stat & st,
+		       const bool & remove_dest )
+{
+	if( remove_dest ) unlink( dest.c_str() );
+	if( S_ISLNK( st.st_mode ) ) {
+		std::vector< char > target( st.st_size > 0 ? st.st_size + 1 : PATH_MAX );
+		ssize_t len = readlink( src.c_str(), target.data(), target.size() );
+		if( len < 0 ) return errno;
+		return symlink( std::string( target.data(), len ).c_str(), dest.c_str() ) == 0 ? 0 : errno;
+	}
+	if( !S_ISREG( st.st_mode ) ) return ENOTSUP;
+	int in = open( src.c_str(), O_RDONLY | O_CLOEXEC );
+	if( in < 0 ) return errno;
+	int out = open( dest.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 07777 );
+	if( out < 0 ) {
+		int err = errno;
+		close( in );
+		return err;
+	}
+	int err = copy_fd( in, out, st.st_size );
+	if( close( out ) != 0 && err == 0 ) err = errno;
+	close( in );
+	return err;
+}
+
+struct tree_entry_t
+{
+	std::string path;
+	struct stat st;
+};
+
+// walks the tree under root (root included) without following symlinks, on an explicit stack
+// calls fn for each entry before descending into it, so a directory can be made readable first
+static void tree_walk( const std::string & root, path_errs_t & errs,
+		       const std::function< void( const tree_entry_t & e ) > & fn )
+{
+	std::vector< std::string > stack( 1, root );
+	tree_entry_t e;
+	while( !stack.empty() ) {
+		e.path = std::move( stack.back() );
+		stack.pop_back();
+		if( lstat( e.path.c_str(), & e.st ) != 0 ) {
+			errs.add( e.path, errno );
+			continue;
+		}
+		fn( e );
+		if( !S_ISDIR( e.st.st_mode ) ) continue;
+		DIR * dir = opendir( e.path.c_str() );
+		if( dir == nullptr ) {
+			errs.add( e.path, errno );
+			continue;
+		}
+		const size_t first = stack.size();
+		struct dirent * ent;
+		while( ( ent = readdir( dir ) ) != nullptr ) {
+			if( strcmp( ent->d_name, "." ) == 0 || strcmp( ent->d_name, ".." ) == 0 ) continue;
+			stack.push_back( e.path + "/" + ent->d_name );
+		}
+		closedir( dir );
+		// popped in directory order
+		std::reverse( stack.begin() + first, stack.end() );
+	}
+}
+
+// recursive copy (cp -r), regular files of large directories are copied in parallel
+bool copy_tree( const std::string & src, const std::string & dest, const bool & remove_dest, path_errs_t & errs )
+{
+	const size_t prev_errs = errs.errs.size();
+	struct stat st;
+	if( lstat( src.c_str(), & st ) != 0 ) {
+		errs.add( src, errno );
+		return false;
+	}
+	if( !S_ISDIR( st.st_mode ) ) {
+		int err = copy_entry( src, dest, st, remove_dest );
+		if( err != 0 ) errs.add( src, err );
+		return err == 0;
+	}
+
+	std::string root = src;
+	while( root.size() > 1 && root.back() == '/' ) root.pop_back();
+	std::vector< tree_entry_t > entries;
+	tree_walk( root, errs, [ & ]( const tree_entry_t & e ) { entries.push_back( e ); } );
+
+	// directories are created first (writable, so they can be filled), in walk order
+	std::vector< tree_entry_t * > files, dirs;
+	for( auto & e : entries ) {
+		const std::string target = dest + e.path.substr( root.size() );
+		if( S_ISDIR( e.st.st_mode ) ) {
+			if( mkdir( target.c_str(), ( e.st.st_mode & 07777 ) | S_IRWXU ) != 0 && errno != EEXIST ) {
+				errs.add( target, errno );
+				continue;
+			}
+			dirs.push_back( & e );
+		} else {
+			files.push_back( & e );
+		}
+	}
+
+	std::atomic< size_t > next( 0 );
+	auto worker = [ & ]() {
+		for( size_t i = next++; i < files.size(); i = next++ ) {
+			const tree_entry_t & e = * files[ i ];
+			int err = copy_entry( e.path, dest + e.path.substr( root.size() ), e.st, remove_dest );
+			if( err != 0 ) errs.add( e.path, err );
+		}
+	};
+	size_t threads = files.size() < COPY_PARALLEL_MIN_FILES ? 1 :
+			 std::min( ( size_t )std::max( std::thread::hardware_concurrency(), 1U ),
+				   files.size() / COPY_PARALLEL_MIN_FILES + 1 );
+	std::vector< std::thread > pool;
+	for( size_t i = 1; i < threads; ++i ) pool.emplace_back( worker );
+	worker();
+	for( auto & t : pool ) t.join();
+
+	// restore the actual directory modes now that they are filled
+	for( auto & e : dirs ) {
+		chmod( ( dest + e->path.substr( root.size() ) ).c_str(), e->st.st_mode & 07777 );
+	}
+	return errs.errs.size() == prev_errs;
+}
+
+// rename, or copy and remove when the destination is on another file system
+bool move_tree( const std::string & src, const std::string & dest, path_errs_t & errs )
+{
+	if( rename( src.c_str(), dest.c_str() ) == 0 ) return true;
+	if( errno != EXDEV ) {
+		errs.add( src, errno );
+		return false;
+	}
+	if( !copy_tree( src, dest, true, errs ) ) return false;
+	return rm_tree( src, errs );
+}
+
+// recursive remove (rm -r)
+bool rm_tree( const std::string & path, path_errs_t & errs )
+{
+	struct stat st;
+	if( lstat( path.c_str(), & st ) != 0 ) {
+		errs.add( path, errno );
+		return false;
+	}
+	if( !S_ISDIR( st.st_mode ) ) {
+		if( unlink( path.c_str() ) == 0 ) return true;
+		errs.add( path, errno );
+		return false;
+	}
+	const size_t prev_errs = errs.errs.size();
+	std::vector< std::string > paths;
+	tree_walk( path, errs, [ & ]( const tree_entry_t & e ) { paths.push_back( e.path ); } );
+	// the walk lists parents before their children
+	for( auto it = paths.rbegin(); it != paths.rend(); ++it ) {
+		if( remove( it->c_str() ) != 0 ) errs.add( * it, errno );
+	}
+	return errs.errs.size() == prev_errs;
+}
+
+bool chmod_tree( const std::string & path, const std::string & mode, const bool & recurse, path_errs_t & errs )
+{
+	struct stat st;
+	if( stat( path.c_str(), & st ) != 0 ) {
+		errs.add( path, errno );
+		return false;
+	}
+	if( !recurse || !S_ISDIR( st.st_mode ) ) {
+		mode_t res;
+		mode_apply( mode, st.st_mode & 07777, S_ISDIR( st.st_mode ), res );
+		if( chmod( path.c_str(), res ) == 0 ) return true;
+		errs.add( path, errno );
+		return false;
+	}
+	const size_t prev_errs = errs.errs.size();
+	tree_walk( path, errs, [ & ]( const tree_entry_t & e ) {
+		if( S_ISLNK( e.st.st_mode ) ) return;
+		mode_t res;
+		mode_apply( mode, e.st.st_mode & 07777, S_ISDIR( e.st.st_mode ), res );
+		if( chmod( e.path.c_str(), res ) != 0 ) errs.add( e.path, errno );
+	} );
+	return errs.errs.size() == prev_errs;
+}
+
+void path_errs_t::add( const std::string & path, const int & err )
+{
+	std::lock_guard< std::mutex > lock( mtx );
+	errs.emplace_back( path, err );
+}
+
+// a vector of path_error_t structs (path, error) for the failed paths, sorted by path
+static var_base_t * path_errs_vec( path_errs_t & errs, const size_t & src_id, const size_t & idx )
+{
+	std::sort( errs.errs.begin(), errs.errs.end() );
+	std::vector< var_base_t * > res;
+	res.reserve( errs.errs.size() );
+	for( auto & e : errs.errs ) {
+		std::unordered_map< std::string, var_base_t * > attrs;
+		attrs[ "path" ] = new var_str_t( e.first, src_id, idx );
+		attrs[ "error" ] = new var_str_t( strerror( e.second ), src_id, idx );
+		res.push_back( new var_struct_t( path_error_struct_id, attrs, src_id, idx ) );
+	}
+	return make< var_vec_t >( res );
+}
+
+int64_t mono_ns()
+{
+	struct timespec ts;
+	clock_gettime( CLOCK_MONOTONIC, & ts );
+	return ( int64_t )ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void sleep_until_ns( const int64_t & deadline )
+{
+#if defined( TIMER_ABSTIME ) && !defined( __APPLE__ )
+	struct timespec ts;
+	ts.tv_sec = deadline / 1000000000;
+	ts.tv_nsec = deadline % 1000000000;
+	if( ts.tv_nsec < 0 ) {
+		--ts.tv_sec;
+		ts.tv_nsec += 1000000000;
+	}
+	while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, & ts, nullptr ) == EINTR );
+#else
+	for( int64_t left = deadline - mono_ns(); left > 0; left = deadline - mono_ns() ) {
+		struct timespec ts = { ( time_t )( left / 1000000000 ), ( long )( left % 1000000000 ) };
+		nanosleep( & ts, nullptr );
+	}
+#endif
+}
+
+std::vector< std::string > env_merge( const std::unordered_map< std::string, std::string > & overrides )
+{
+	std::vector< std::string > env;
+	for( char ** e = environ; * e != nullptr; ++e ) {
+		const char * eq = strchr( * e, '=' );
+		if( eq != nullptr && overrides.find( std::string( * e, eq - * e ) ) != overrides.end() ) continue;
+		env.push_back( * e );
+	}
+	for( auto & o : overrides ) env.push_back( o.first + "=" + o.second );
+	return env;
+}
+
+static void close_fd( int & fdesc )
+{
+	if( fdesc < 0 ) return;
+	close( fdesc );
+	fdesc = -1;
+}
+
+// pipe with both ends close on exec - without pipe2 (macOS) there is a window in which
+// another thread's spawn can inherit the ends, same as the rest of the interpreter's fds
+static int pipe_cloexec( int fds[ 2 ] )
+{
+#if defined( __linux__ ) || defined( __FreeBSD__ ) || defined( __NetBSD__ ) || defined( __OpenBSD__ )
+	return pipe2( fds, O_CLOEXEC );
+#else
+	if( pipe( fds ) != 0 ) return -1;
+	if( fcntl( fds[ 0 ], F_SETFD, FD_CLOEXEC ) != 0 || fcntl( fds[ 1 ], F_SETFD, FD_CLOEXEC ) != 0 ) {
+		int err = errno;
+		close_fd( fds[ 0 ] );
+		close_fd( fds[ 1 ] );
+		errno = err;
+		return -1;
+	}
+	return 0;
+#endif
+}
+
+void proc_reset( proc_t & proc )
+{
+	proc.pid = -1;
+	proc.pidfd = proc.in_fd = proc.out_fd = proc.err_fd = -1;
+	proc.input_off = 0;
+	proc.status = 0;
+	proc.reaped = proc.done = proc.timed_out = false;
+	proc.start_ns = proc.end_ns = mono_ns();
+}
+
+int proc_spawn( proc_t & proc, const std::vector< std::string > & argv, const std::vector< std::string > & env,
+		const bool & custom_env, const std::string & cwd, const bool & capture, const bool & has_input )
+{
+	proc_reset( proc );
+
+	// all pipe ends are close on exec - the child gets its ends through dup2
+	int in_p[ 2 ] = { -1, -1 }, out_p[ 2 ] = { -1, -1 }, err_p[ 2 ] = { -1, -1 };
+	int err = 0;
+	if( has_input && pipe_cloexec( in_p ) != 0 ) err = errno;
+	if( err == 0 && capture && ( pipe_cloexec( out_p ) != 0 || pipe_cloexec( err_p ) != 0 ) ) err = errno;
+
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init( & actions );
+	if( in_p[ 0 ] >= 0 ) posix_spawn_file_actions_adddup2( & actions, in_p[ 0 ], STDIN_FILENO );
+	if( out_p[ 1 ] >= 0 ) posix_spawn_file_actions_adddup2( & actions, out_p[ 1 ], STDOUT_FILENO );
+	if( err_p[ 1 ] >= 0 ) posix_spawn_file_actions_adddup2( & actions, err_p[ 1 ], STDERR_FILENO );
+#if SPAWN_HAS_ADDCHDIR
+	if( !cwd.empty() ) posix_spawn_file_actions_addchdir_np( & actions, cwd.c_str() );
+#else
+	// no way to chdir in the child - switch the interpreter's directory around the spawn instead
+	int prev_cwd = -1;
+	if( err == 0 && !cwd.empty() ) {
+		// without a way back, the directory must not be changed at all
+		prev_cwd = open( ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC );
+		if( prev_cwd < 0 ) err = errno;
+		else if( chdir( cwd.c_str() ) != 0 ) err = errno;
+	}
+#endif
+
+	std::vector< char * > cargv, cenv;
+	for( auto & a : argv ) cargv.push_back( const_cast< char * >( a.c_str() ) );
+	cargv.push_back( nullptr );
+	for( auto & e : env ) cenv.push_back( const_cast< char * >( e.c_str() ) );
+	cenv.push_back( nullptr );
+
+	if( err == 0 ) {
+		err = posix_spawnp( & proc.pid, cargv[ 0 ], & actions, nullptr, cargv.data(),
+				    custom_env ? cenv.data() : environ );
+	}
+	posix_spawn_file_actions_destroy( & actions );
+#if !SPAWN_HAS_ADDCHDIR
+	if( prev_cwd >= 0 ) {
+		// the child is running by now, nothing to undo if this fails
+		int res = fchdir( prev_cwd );
+		( void )res;
+		close( prev_cwd );
+	}
+#endif
+
+	close_fd( in_p[ 0 ] );
+	close_fd( out_p[ 1 ] );
+	close_fd( err_p[ 1 ] );
+	proc.in_fd = in_p[ 1 ];
+	proc.out_fd = out_p[ 0 ];
+	proc.err_fd = err_p[ 0 ];
+	if( err != 0 ) {
+		proc.pid = -1;
+		close_fd( proc.in_fd );
+		close_fd( proc.out_fd );
+		close_fd( proc.err_fd );
+		return err;
+	}
+	for( int f : { proc.in_fd, proc.out_fd, proc.err_fd } ) {
+		if( f >= 0 ) fcntl( f, F_SETFL, fcntl( f, F_GETFL ) | O_NONBLOCK );
+	}
+	if( proc.in_fd >= 0 && proc.input.empty() ) close_fd( proc.in_fd );
+#if defined( __linux__ ) && defined( SYS_pidfd_open )
+	proc.pidfd = syscall( SYS_pidfd_open, proc.pid, 0 );
+#endif
+	return 0;
+}
+
+int proc_pollfds( const proc_t & proc, std::vector< struct pollfd > & fds )
+{
+	if( proc.done ) return -1;
+	if( proc.in_fd >= 0 ) fds.push_back( { proc.in_fd, POLLOUT, 0 } );
+	if( proc.out_fd >= 0 ) fds.push_back( { proc.out_fd, POLLIN, 0 } );
+	if( proc.err_fd >= 0 ) fds.push_back( { proc.err_fd, POLLIN, 0 } );
+	if( proc.reaped ) return -1;
+	if( proc.pidfd >= 0 ) {
+		fds.push_back( { proc.pidfd, POLLIN, 0 } );
+		return -1;
+	}
+	// without a pidfd, the exit is noticed by waking up periodically once the pipes are closed
+	return proc.out_fd < 0 && proc.err_fd < 0 ? PROC_REAP_POLL_MS : -1;
+}
+
+// reads what is available on the pipe, closing it at the end
+static void proc_drain( int & fdesc, std::string & dest )
+{
+	char buf[ 64 * 1024 ];
+	while( fdesc >= 0 ) {
+		ssize_t len = read( fdesc, buf, sizeof( buf ) );
+		if( len < 0 && errno == EINTR ) continue;
+		if( len < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) ) return;
+		if( len <= 0 ) {
+			close_fd( fdesc );
+			return;
+		}
+		dest.append( buf, len );
+	}
+}
+
+void proc_service( proc_t & proc )
+{
+	if( proc.done ) return;
+	if( proc.in_fd >= 0 ) {
+		// a child which does not read its input must not kill the interpreter with SIGPIPE
+		sigset_t pipe_set, prev_set;
+		sigemptyset( & pipe_set );
+		sigaddset( & pipe_set, SIGPIPE );
+		pthread_sigmask( SIG_BLOCK, & pipe_set, & prev_set );
+		while( proc.input_off < proc.input.size() ) {
+			ssize_t len = write( proc.in_fd, proc.input.data() + proc.input_off, proc.input.size() - proc.input_off );
+			if( len < 0 && errno == EINTR ) continue;
+			if( len < 0 && ( errno == EAGAIN || errno == EWOULDBLOCK ) ) break;
+			if( len < 0 ) {
+				proc.input_off = proc.input.size();
+				break;
+			}
+			proc.input_off += len;
+		}
+		if( proc.input_off >= proc.input.size() ) close_fd( proc.in_fd );
+		struct timespec zero = { 0, 0 };
+		while( sigtimedwait( & pipe_set, nullptr, & zero ) == SIGPIPE );
+		pthread_sigmask( SIG_SETMASK, & prev_set, nullptr );
+	}
+	proc_drain( proc.out_fd, proc.out );
+	proc_drain( proc.err_fd, proc.err );
+	if( !proc.reaped && waitpid( proc.pid, & proc.status, WNOHANG ) == proc.pid ) {
+		proc.reaped = true;
+		proc.end_ns = mono_ns();
+	}
+	if( !proc.reaped || proc.out_fd >= 0 || proc.err_fd >= 0 ) return;
+	close_fd( proc.in_fd );
+	close_fd( proc.pidfd );
+	proc.done = true;
+}
+
+void proc_kill( proc_t & proc )
+{
+	if( proc.done ) return;
+	if( proc.pid > 0 && !proc.reaped ) {
+		kill( proc.pid, SIGKILL );
+		while( waitpid( proc.pid, & proc.status, 0 ) < 0 && errno == EINTR );
+		proc.reaped = true;
+		proc.end_ns = mono_ns();
+	}
+	close_fd( proc.in_fd );
+	close_fd( proc.out_fd );
+	close_fd( proc.err_fd );
+	close_fd( proc.pidfd );
+	proc.done = true;
+}
+
+// parses "<key> <value> kB" from the /proc/self/status contents
+static int64_t status_kb( const char * status, const char * key )
+{
+	const char * p = strstr( status, key );
+	if( p == nullptr ) return -1;
+	return strtoll( p + strlen( key ), nullptr, 10 ) * 1024;
+}
+
+void mem_read( mem_info_t & mem )
+{
+	mem.rss = mem.hwm = mem.fds = -1;
+#if __linux__
+	// a single read - the file is generated in one go, and is a couple of KiB
+	char buf[ 8192 ];
+	int fdesc = open( "/proc/self/status", O_RDONLY | O_CLOEXEC );
+	if( fdesc >= 0 ) {
+		ssize_t len = read( fdesc, buf, sizeof( buf ) - 1 );
+		close( fdesc );
+		if( len > 0 ) {
+			buf[ len ] = '\0';
+			mem.rss = status_kb( buf, "VmRSS:" );
+			mem.hwm = status_kb( buf, "VmHWM:" );
+		}
+	}
+	DIR * dir = opendir( "/proc/self/fd" );
+	if( dir != nullptr ) {
+		int64_t count = 0;
+		while( readdir( dir ) != nullptr ) ++count;
+		closedir( dir );
+		// ".", ".." and the descriptor of the directory itself
+		mem.fds = count - 3;
+	}
+#endif
+}
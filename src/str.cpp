@@ -9,6 +9,8 @@
 
 #include <feral/VM/VM.hpp>
 
+#include "common/profile.hpp"
+
 std::vector< var_base_t * > _str_split( const std::string & data, const char delim,
 					const size_t & src_id, const size_t & idx );
 
@@ -173,22 +175,22 @@ INIT_MODULE( str )
 {
 	var_src_t * src = vm.src_stack.back();
 
-	vm.add_typefn_native( VT_STR,     "len", str_size,   0, src_id, idx );
-	vm.add_typefn_native( VT_STR,   "empty", str_empty,  0, src_id, idx );
-	vm.add_typefn_native( VT_STR,   "front", str_front,  0, src_id, idx );
-	vm.add_typefn_native( VT_STR,    "back", str_back,   0, src_id, idx );
-	vm.add_typefn_native( VT_STR,    "push", str_push,   1, src_id, idx );
-	vm.add_typefn_native( VT_STR,     "pop", str_pop,    0, src_id, idx );
-	vm.add_typefn_native( VT_STR,  "insert", str_insert, 2, src_id, idx );
-	vm.add_typefn_native( VT_STR,   "erase", str_erase,  1, src_id, idx );
-	vm.add_typefn_native( VT_STR, "lastidx", str_last,   0, src_id, idx );
-	vm.add_typefn_native( VT_STR,     "set", str_setat,  2, src_id, idx );
-
-	vm.add_typefn_native( VT_STR,  "trim", str_trim, 0, src_id, idx );
-	vm.add_typefn_native( VT_STR, "split_native", str_split, 1, src_id, idx );
-
-	vm.add_typefn_native( VT_STR, "c_to_i", c_to_i, 0, src_id, idx );
-	vm.add_typefn_native( VT_INT, "i_to_c", i_to_c, 0, src_id, idx );
+	vm.add_typefn_native( VT_STR,     "len", PROF( str_size ),   0, src_id, idx );
+	vm.add_typefn_native( VT_STR,   "empty", PROF( str_empty ),  0, src_id, idx );
+	vm.add_typefn_native( VT_STR,   "front", PROF( str_front ),  0, src_id, idx );
+	vm.add_typefn_native( VT_STR,    "back", PROF( str_back ),   0, src_id, idx );
+	vm.add_typefn_native( VT_STR,    "push", PROF( str_push ),   1, src_id, idx );
+	vm.add_typefn_native( VT_STR,     "pop", PROF( str_pop ),    0, src_id, idx );
+	vm.add_typefn_native( VT_STR,  "insert", PROF( str_insert ), 2, src_id, idx );
+	vm.add_typefn_native( VT_STR,   "erase", PROF( str_erase ),  1, src_id, idx );
+	vm.add_typefn_native( VT_STR, "lastidx", PROF( str_last ),   0, src_id, idx );
+	vm.add_typefn_native( VT_STR,     "set", PROF( str_setat ),  2, src_id, idx );
+
+	vm.add_typefn_native( VT_STR,  "trim", PROF( str_trim ), 0, src_id, idx );
+	vm.add_typefn_native( VT_STR, "split_native", PROF( str_split ), 1, src_id, idx );
+
+	vm.add_typefn_native( VT_STR, "c_to_i", PROF( c_to_i ), 0, src_id, idx );
+	vm.add_typefn_native( VT_INT, "i_to_c", PROF( i_to_c ), 0, src_id, idx );
 
 	return true;
 }
@@ -7,8 +7,16 @@
 	before using or altering the project.
 */
 
+#include <cerrno>
+#include <cstring>
+
 #include <feral/VM/VM.hpp>
 
+#include "common/profile.hpp"
+
+// initialize this in the init_sys function
+static int prof_entry_struct_id;
+
 var_base_t * _exit( vm_state_t & vm, const fn_data_t & fd )
 {
 	srcfile_t * src_file = vm.src_stack.back()->src();
@@ -51,15 +59,74 @@ var_base_t * feral_home_dir( vm_state_t & vm, const fn_data_t & fd )
 	return make< var_str_t >( vm.feral_home_dir() );
 }
 
+// returns false if FERAL_STD_PROFILE was not set when the modules were loaded
+var_base_t * profile_start( vm_state_t & vm, const fn_data_t & fd )
+{
+	return prof_start() ? vm.tru : vm.fals;
+}
+
+var_base_t * profile_stop( vm_state_t & vm, const fn_data_t & fd )
+{
+	prof_stop();
+	return vm.nil;
+}
+
+var_base_t * profile_reset( vm_state_t & vm, const fn_data_t & fd )
+{
+	prof_reset();
+	return vm.nil;
+}
+
+// with an empty file, returns a map of native function name => profile_entry_t
+// otherwise writes the folded stacks to the file and returns nil
+var_base_t * profile_report( vm_state_t & vm, const fn_data_t & fd )
+{
+	srcfile_t * src = vm.src_stack.back()->src();
+	if( fd.args[ 1 ]->type() != VT_STR ) {
+		src->fail( fd.idx, "expected string argument for file, found: %s",
+			   vm.type_name( fd.args[ 1 ]->type() ).c_str() );
+		return nullptr;
+	}
+	const std::string & file = STR( fd.args[ 1 ] )->get();
+	if( !file.empty() ) {
+		if( !prof_write_folded( file ) ) {
+			src->fail( fd.idx, "failed to write profile to file: %s, error: %s",
+				   file.c_str(), strerror( errno ) );
+			return nullptr;
+		}
+		return vm.nil;
+	}
+	std::unordered_map< std::string, var_base_t * > res;
+	for( auto & stat : prof_stats() ) {
+		std::unordered_map< std::string, var_base_t * > attrs;
+		attrs[ "calls" ] = new var_int_t( ( long )stat.calls, fd.src_id, fd.idx );
+		attrs[ "total_ns" ] = new var_int_t( ( long )stat.total_ns, fd.src_id, fd.idx );
+		attrs[ "self_ns" ] = new var_int_t( ( long )stat.self_ns, fd.src_id, fd.idx );
+		attrs[ "result_bytes" ] = new var_int_t( ( long )stat.result_bytes, fd.src_id, fd.idx );
+		res[ stat.name ] = new var_struct_t( prof_entry_struct_id, attrs, fd.src_id, fd.idx );
+	}
+	return make< var_map_t >( res );
+}
+
 INIT_MODULE( sys )
 {
 	var_src_t * src = vm.src_stack.back();
-	src->add_nativefn( "exit_native", _exit, 1 );
-	src->add_nativefn( "self_binary_loc_native", self_binary_loc );
-	src->add_nativefn( "src_args_native", src_args );
-	src->add_nativefn( "inc_load_loc_native", inc_load_loc );
-	src->add_nativefn( "dll_load_loc_native", dll_load_loc );
-	src->add_nativefn( "dll_core_load_loc_native", dll_core_load_loc );
-	src->add_nativefn( "feral_home_dir_native", feral_home_dir );
+	src->add_nativefn( "exit_native", PROF( _exit ), 1 );
+	src->add_nativefn( "self_binary_loc_native", PROF( self_binary_loc ) );
+	src->add_nativefn( "src_args_native", PROF( src_args ) );
+	src->add_nativefn( "inc_load_loc_native", PROF( inc_load_loc ) );
+	src->add_nativefn( "dll_load_loc_native", PROF( dll_load_loc ) );
+	src->add_nativefn( "dll_core_load_loc_native", PROF( dll_core_load_loc ) );
+	src->add_nativefn( "feral_home_dir_native", PROF( feral_home_dir ) );
+
+	// get the struct id for profile entries
+	prof_entry_struct_id = vm.register_struct_enum_id();
+	vm.set_typename( prof_entry_struct_id, "profile_entry_t" );
+
+	// the profiler's own functions are never wrapped
+	src->add_nativefn( "profile_start", profile_start );
+	src->add_nativefn( "profile_stop", profile_stop );
+	src->add_nativefn( "profile_reset", profile_reset );
+	src->add_nativefn( "profile_report_native", profile_report, 1 );
 	return true;
 }
@@ -9,6 +9,8 @@
 
 #include <feral/VM/VM.hpp>
 
+#include "common/profile.hpp"
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////// Classes //////////////////////////////////////////////////////////////////
 ////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -237,28 +239,28 @@ INIT_MODULE( vec )
 {
 	var_src_t * src = vm.src_stack.back();
 
-	src->add_nativefn( "new", vec_new, 0, true );
+	src->add_nativefn( "new", PROF( vec_new ), 0, true );
 
-	vm.add_typefn_native( VT_VEC,   "len",    vec_size, 0, src_id, idx );
-	vm.add_typefn_native( VT_VEC, "empty",   vec_empty, 0, src_id, idx );
-	vm.add_typefn_native( VT_VEC, "front",   vec_front, 0, src_id, idx );
-	vm.add_typefn_native( VT_VEC,  "back",    vec_back, 0, src_id, idx );
-	vm.add_typefn_native( VT_VEC,  "push",    vec_push, 1, src_id, idx );
-	vm.add_typefn_native( VT_VEC,   "pop",     vec_pop, 0, src_id, idx );
-	vm.add_typefn_native( VT_VEC, "insert", vec_insert, 2, src_id, idx );
-	vm.add_typefn_native( VT_VEC, "erase",   vec_erase, 1, src_id, idx );
-	vm.add_typefn_native( VT_VEC, "lastidx",  vec_last, 0, src_id, idx );
-	vm.add_typefn_native( VT_VEC,   "set",   vec_setat, 2, src_id, idx );
-	vm.add_typefn_native( VT_VEC,    "at",      vec_at, 1, src_id, idx );
-	vm.add_typefn_native( VT_VEC,    "[]",      vec_at, 1, src_id, idx );
-	vm.add_typefn_native( VT_VEC,  "each",    vec_each, 0, src_id, idx );
+	vm.add_typefn_native( VT_VEC,   "len",    PROF( vec_size ), 0, src_id, idx );
+	vm.add_typefn_native( VT_VEC, "empty",   PROF( vec_empty ), 0, src_id, idx );
+	vm.add_typefn_native( VT_VEC, "front",   PROF( vec_front ), 0, src_id, idx );
+	vm.add_typefn_native( VT_VEC,  "back",    PROF( vec_back ), 0, src_id, idx );
+	vm.add_typefn_native( VT_VEC,  "push",    PROF( vec_push ), 1, src_id, idx );
+	vm.add_typefn_native( VT_VEC,   "pop",     PROF( vec_pop ), 0, src_id, idx );
+	vm.add_typefn_native( VT_VEC, "insert", PROF( vec_insert ), 2, src_id, idx );
+	vm.add_typefn_native( VT_VEC, "erase",   PROF( vec_erase ), 1, src_id, idx );
+	vm.add_typefn_native( VT_VEC, "lastidx",  PROF( vec_last ), 0, src_id, idx );
+	vm.add_typefn_native( VT_VEC,   "set",   PROF( vec_setat ), 2, src_id, idx );
+	vm.add_typefn_native( VT_VEC,    "at",      PROF( vec_at ), 1, src_id, idx );
+	vm.add_typefn_native( VT_VEC,    "[]",      PROF( vec_at ), 1, src_id, idx );
+	vm.add_typefn_native( VT_VEC,  "each",    PROF( vec_each ), 0, src_id, idx );
 
-	vm.add_typefn_native( VT_VEC, "slice_native", vec_slice, 2, src_id, idx );
+	vm.add_typefn_native( VT_VEC, "slice_native", PROF( vec_slice ), 2, src_id, idx );
 
 	// get the type id for vec iterable (register_type)
 	vec_iterable_typeid = vm.register_new_type( "vec_iterable_t", src_id, idx );
 
-	vm.add_typefn_native( vec_iterable_typeid, "next", vec_iterable_next, 0, src_id, idx );
+	vm.add_typefn_native( vec_iterable_typeid, "next", PROF( vec_iterable_next ), 0, src_id, idx );
 
 	return true;
 }